@@ -1,19 +1,22 @@
 #include <boost/thread/mutex.hpp>
 
-#include <libusb.h>
-
 #include <ros/ros.h>
 #include <camera_info_manager/camera_info_manager.h>
 #include <image_transport/image_transport.h>
 #include <cv_bridge/cv_bridge.h>
 #include <sensor_msgs/fill_image.h>
+#include <flir_one_node/ThermalRoiStats.h>
+#include <flir_one_node/RawFrame.h>
+
+#include "flir_one_node/flir_one_core.h"
+#include "flir_one_node/flir_one_shm.h"
 
 /** @file
 
-    @brief ROS driver interface for UEYE-compatible USB digital cameras.
+    @brief ROS driver interface for the FLIR One G2, a thin wrapper
+    publishing the frames decoded by FlirOneCore.
 
 */
-#define BUF85SIZE 1048576
 
 using namespace std;
 
@@ -33,70 +36,28 @@ namespace driver_flir
 
     bool ok();
 
-  private:
-    void publish(const sensor_msgs::ImagePtr &image);
-    void read(char ep[], char EP_error[], int r, int actual_length, unsigned char buf[]);
-
-    void print_bulk_result(char ep[], char EP_error[], int r, int actual_length, unsigned char buf[]);
-    void getHeatMapColorFromValue(const float &value, float *red, float *green, float *blue);
-    void setColors(float color_list[][3], const int num_base_colors);
+    // decode the frames of a raw/frame topic instead of polling the camera
+    void subscribeRaw(void);
 
-    libusb_context *context;
-    struct libusb_device_handle *devh;
-
-    unsigned char buf[1048576];
-    int actual_length;
-    char EP81_error[50];
-    char EP83_error[50];
-    char EP85_error[50];
-    int buf85pointer = 0;
-    unsigned char buf85[BUF85SIZE];
-    vector<vector<float>> color_list_;
+  private:
+    void loadRois(FlirOneConfig &config);
+    void updateOutputs(void);
+    void publishFrame(const FlirOneFrame &frame);
+    void rawFrameCallback(const flir_one_node::RawFrameConstPtr &msg);
+    void publishRoiStats(const FlirOneFrame &frame, const std_msgs::Header &header);
 
-    float min_val;
-    float max_val;
-    float delta_val;
+    boost::shared_ptr<FlirOneCore> core_;
 
     bool publish_ir_image;
     bool publish_rgb_image;
-    bool ir_img_color;
-    int ir_img_width, ir_img_height;
-
-    enum states_t
-    {
-      INIT,
-      INIT_1,
-      INIT_2,
-      ASK_ZIP,
-      ASK_VIDEO,
-      POOL_FRAME,
-      ERROR
-    };
-    states_t states;
-
-    enum setup_states_t
-    {
-      SETUP_INIT,
-      SETUP_LISTING,
-      SETUP_FIND,
-      SETUP_SET_CONF,
-      SETUP_CLAIM_INTERFACE_0,
-      SETUP_CLAIM_INTERFACE_1,
-      SETUP_CLAIM_INTERFACE_2,
-      SETUP_ALL_OK,
-      SETUP_ERROR
-    };
-    setup_states_t setup_states;
-
-    int error_code;
-
-    bool isOk;
-
-    long long fps_t;
-    struct timeval t1, t2;
-
-    int vendor_id;
-    int product_id;
+    bool publish_roi_stats;
+    bool publish_fused_image;
+    bool publish_ir_16b_image;
+    bool raw_only;
+
+    // shared-memory ring for local non-ROS consumers
+    FlirOneShmWriter shm_writer_;
+    bool shm_jpeg;
 
     ros::NodeHandle nh_;        // node handle
     ros::NodeHandle priv_nh_;   // private node handle
@@ -106,8 +67,13 @@ namespace driver_flir
 
     /** image transport interfaces */
     boost::shared_ptr<image_transport::ImageTransport> it_;
-    ros::Publisher image_pub_;
+    image_transport::Publisher image_16b_pub_;
     ros::Publisher image_rgb_pub_;
     ros::Publisher image_ir_pub_;
+    ros::Publisher roi_stats_pub_;
+    ros::Publisher image_fused_pub_;
+    ros::Publisher raw_frame_pub_;
+    ros::Subscriber raw_frame_sub_;
+    ros::Time raw_stamp_; // stamp of the raw frame being decoded
   };
 };
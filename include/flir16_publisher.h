@@ -0,0 +1,32 @@
+#ifndef FLIR16_PUBLISHER_H
+#define FLIR16_PUBLISHER_H
+
+#include <image_transport/simple_publisher_plugin.h>
+#include <sensor_msgs/CompressedImage.h>
+
+/** @file
+
+    @brief "flir16" image_transport publisher: lossless compression of
+    16-bit thermal images with the thermal codec.
+
+*/
+
+namespace driver_flir
+{
+
+  class Flir16Publisher : public image_transport::SimplePublisherPlugin<sensor_msgs::CompressedImage>
+  {
+  public:
+    virtual ~Flir16Publisher() {}
+
+    virtual std::string getTransportName() const
+    {
+      return "flir16";
+    }
+
+  protected:
+    virtual void publish(const sensor_msgs::Image &message, const PublishFn &publish_fn) const;
+  };
+};
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef FLIR16_SUBSCRIBER_H
+#define FLIR16_SUBSCRIBER_H
+
+#include <image_transport/simple_subscriber_plugin.h>
+#include <sensor_msgs/CompressedImage.h>
+
+/** @file
+
+    @brief "flir16" image_transport subscriber, decodes the images of
+    Flir16Publisher.
+
+*/
+
+namespace driver_flir
+{
+
+  class Flir16Subscriber : public image_transport::SimpleSubscriberPlugin<sensor_msgs::CompressedImage>
+  {
+  public:
+    virtual ~Flir16Subscriber() {}
+
+    virtual std::string getTransportName() const
+    {
+      return "flir16";
+    }
+
+  protected:
+    virtual void internalCallback(const sensor_msgs::CompressedImageConstPtr &message, const Callback &user_cb);
+  };
+};
+
+#endif
@@ -0,0 +1,242 @@
+#ifndef FLIR_ONE_CORE_H
+#define FLIR_ONE_CORE_H
+
+#include <sys/time.h>
+
+#include <functional>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+// libusb stays out of the public header, only handles are kept here
+struct libusb_context;
+struct libusb_device_handle;
+
+/** @file
+
+    @brief ROS-free FLIR One G2 driver core: USB handshake, 0x85 frame
+    reassembly, thermal extraction and colourisation.
+
+*/
+#define BUF85SIZE 1048576
+
+// Automatic range histogram: raw 16-bit counts are binned by 2^AGC_HIST_SHIFT
+// (4 counts ~ 0.09 degC per bin)
+#define AGC_HIST_SHIFT 2
+#define AGC_HIST_BINS (65536 >> AGC_HIST_SHIFT)
+
+// Fractional bits of the temporal filter accumulator. The rounded update stops
+// within 2^(shift-1) of the input, so with shift <= 8 the filtered value
+// settles within 1/32 count (16-bit counts << 12 still fit an int32)
+#define FILTER_FRAC_BITS 12
+
+namespace driver_flir
+{
+
+  // Outputs computed for each frame, see FlirOneCore::setOutputs()
+  enum FlirOneOutput
+  {
+    OUTPUT_RGB = 1 << 0,       // decoded visible image
+    OUTPUT_THERMAL = 1 << 1,   // 160x120 raw 16-bit thermal counts
+    OUTPUT_IR = 1 << 2,        // scaled mono8/rgb8 thermal image
+    OUTPUT_FUSED = 1 << 3,     // thermal overlaid on the visible image
+    OUTPUT_ROI_STATS = 1 << 4  // temperature statistics of the rois
+  };
+
+  struct FlirOneConfig
+  {
+    FlirOneConfig();
+
+    int vendor_id;
+    int product_id;
+
+    float min_temp; // [celsius] bottom of the display range
+    float max_temp; // [celsius] top of the display range
+    bool ir_img_color;
+    int ir_img_width, ir_img_height;
+
+    bool auto_range;
+    float agc_low_percentile;
+    float agc_high_percentile;
+    float agc_smoothing;
+    float agc_hysteresis; // [celsius]
+
+    bool temporal_filter;
+    int temporal_filter_shift;
+    float temporal_filter_reset; // [celsius]
+
+    std::vector<cv::Rect> rois; // in the 160x120 thermal frame, empty for the whole frame
+
+    float fusion_alpha;
+    cv::Mat fusion_homography; // 3x3, 160x120 thermal pixel to visible pixel
+  };
+
+  struct RoiStatistics
+  {
+    cv::Rect roi;
+    float min_temp, max_temp, mean_temp; // [celsius]
+    int max_x, max_y;                    // hottest pixel location
+  };
+
+  // A decoded frame. Images may point to driver buffers and are only valid
+  // during the frame callback, clone them to keep them.
+  struct FlirOneFrame
+  {
+    unsigned int outputs; // OUTPUT_* flags of the members below that are filled
+    struct timeval stamp; // wall clock (gettimeofday) when read from the camera
+
+    // complete 0x85 frame: 28-byte header, thermal, jpeg and status blocks
+    const unsigned char *raw;
+    size_t raw_size;
+    const unsigned char *jpeg;
+    size_t jpeg_size;
+
+    cv::Mat rgb;     // rgb8
+    cv::Mat thermal; // 16UC1, temporally filtered when enabled
+    cv::Mat ir;      // rgb8 or mono8, ir_img_width x ir_img_height
+    cv::Mat fused;   // rgb8, visible frame size
+    std::vector<RoiStatistics> rois;
+  };
+
+  // min/max/mean and hottest pixel inside a region of the 160x120 thermal frame,
+  // accumulated row by row while the frame is extracted
+  struct RoiAccumulator
+  {
+    int x, y, width, height;
+    int min, max;
+    int max_x, max_y;
+    unsigned long sum;
+  };
+
+  class FlirOneCore
+  {
+  public:
+    typedef std::function<void(const FlirOneFrame &)> FrameCallback;
+
+    explicit FlirOneCore(const FlirOneConfig &config);
+    ~FlirOneCore();
+    void poll(void);
+    void setup(void);
+    void shutdown(void);
+
+    bool ok();
+
+    void setFrameCallback(const FrameCallback &callback);
+    void setOutputs(unsigned int outputs);
+    // returns false and keeps the previous homography if it is not an invertible 3x3 matrix
+    bool setFusionHomography(const cv::Mat &homography);
+
+    // [celsius] range mapped to the ir image, follows the automatic range when enabled
+    void getDisplayRange(float &min_temp, float &max_temp) const;
+
+    // decode a complete 0x85 frame, as reassembled by read()
+    void processFrame(const unsigned char *frame, size_t size, const struct timeval &stamp);
+
+  private:
+    void read(const char ep[], char EP_error[], int r, int actual_length, unsigned char buf[]);
+
+    void print_bulk_result(const char ep[], char EP_error[], int r, int actual_length, unsigned char buf[]);
+    void getHeatMapColorFromValue(const float &value, float *red, float *green, float *blue);
+    void setColors(float color_list[][3], const int num_base_colors);
+    void filterRow(unsigned short *__restrict row, int32_t *__restrict acc, const int width, const int32_t reset_val);
+    void thermalToImage(const cv::Mat &im16, cv::Mat &thermal_data, const int width, const int height);
+    void buildFusionMaps(const cv::Size &size);
+    void fuse(const cv::Mat &visible, const cv::Mat &thermal_data, cv::Mat &fused);
+    void updateAutoRange(const int num_pixels, const int v_min, const int v_max);
+
+    struct libusb_context *context;
+    struct libusb_device_handle *devh;
+
+    std::vector<unsigned char> buf;
+    int actual_length;
+    char EP81_error[50];
+    char EP83_error[50];
+    char EP85_error[50];
+    int buf85pointer = 0;
+    std::vector<unsigned char> buf85;
+    std::vector<std::vector<float>> color_list_;
+
+    float min_val;
+    float max_val;
+    float delta_val;
+
+    bool ir_img_color;
+    int ir_img_width, ir_img_height;
+
+    // automatic range (AGC) parameters and state
+    bool auto_range;
+    float agc_low_percentile;
+    float agc_high_percentile;
+    float agc_smoothing;
+    float agc_hysteresis;
+    bool agc_initialized_;
+    float agc_low_;
+    float agc_high_;
+    std::vector<unsigned int> agc_hist_;
+
+    // temporal denoising of the raw thermal counts
+    bool temporal_filter;
+    int temporal_filter_shift;
+    float temporal_filter_reset;
+    bool filter_initialized_;
+    std::vector<int32_t> filter_acc_;
+
+    std::vector<unsigned short> pix_;
+    std::vector<RoiAccumulator> rois_;
+
+    // thermal over visible overlay, remap tables are rebuilt only when the
+    // homography or the visible frame size changes. They only cover
+    // fusion_rect_, the bounding rect of the thermal footprint.
+    float fusion_alpha;
+    cv::Mat fusion_homography_;
+    cv::Mat fusion_thermal_; // 160x120 colourised thermal image
+    cv::Mat fusion_map1_, fusion_map2_;
+    cv::Rect fusion_rect_;
+    bool fusion_covered_; // fusion_rect_ is entirely inside the footprint
+    cv::Mat fusion_warp_, fusion_fused_;
+    cv::Size fusion_map_size_;
+    bool fusion_maps_valid_;
+
+    unsigned int outputs_;
+    FrameCallback frame_callback_;
+    FlirOneFrame frame_;
+
+    enum states_t
+    {
+      INIT,
+      INIT_1,
+      INIT_2,
+      ASK_ZIP,
+      ASK_VIDEO,
+      POOL_FRAME,
+      ERROR
+    };
+    states_t states;
+
+    enum setup_states_t
+    {
+      SETUP_INIT,
+      SETUP_LISTING,
+      SETUP_FIND,
+      SETUP_SET_CONF,
+      SETUP_CLAIM_INTERFACE_0,
+      SETUP_CLAIM_INTERFACE_1,
+      SETUP_CLAIM_INTERFACE_2,
+      SETUP_ALL_OK,
+      SETUP_ERROR
+    };
+    setup_states_t setup_states;
+
+    int error_code;
+
+    bool isOk;
+
+    long long fps_t;
+    struct timeval t1, t2;
+
+    int vendor_id;
+    int product_id;
+  };
+};
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef FLIR_ONE_SHM_H
+#define FLIR_ONE_SHM_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "flir_one_node/flir_one_core.h"
+
+/** @file
+
+    @brief POSIX shared-memory frame ring for local non-ROS consumers.
+
+    Layout of the shared memory object (native byte order, 8-byte aligned):
+    a ShmRingHeader, then num_slots slots of slot_size bytes starting at
+    header_size. Each slot is a ShmSlotHeader followed by the thermal, ir and
+    rgb blocks at the offsets given in the slot header (from the slot start).
+
+    Frame seq (1, 2, ...) is written in slot (seq - 1) % num_slots. While it is
+    written the slot lock is 2 * seq - 1, then 2 * seq. Readers take no lock:
+    they copy the slot and keep the copy only if the lock was 2 * seq before
+    and after the copy.
+
+    The writer unlinks the object when it closes, and a restarted writer
+    creates a new one: readers still attached to the old mapping would wait
+    forever. The writer clears the magic when it closes; readers should poll
+    FlirOneShmReader::stale() (e.g. once readLatest() has returned false for
+    a while) and attach() again when it returns true. stale() also detects a
+    writer that died without closing, by comparing the object now behind the
+    name with the mapped one.
+*/
+#define SHM_MAGIC 0x4d485331524c4946ULL // "FLIR1SHM"
+#define SHM_VERSION 1
+
+// data capacity of a slot
+#define SHM_THERMAL_SIZE (160 * 120 * 2)
+#define SHM_IR_SIZE (160 * 120 * 3)
+#define SHM_RGB_SIZE (640 * 480 * 3)
+
+namespace driver_flir
+{
+
+  enum ShmFormat
+  {
+    SHM_NONE = 0,
+    SHM_MONO8 = 1,
+    SHM_RGB8 = 2,
+    SHM_MONO16 = 3,
+    SHM_JPEG = 4
+  };
+
+  struct ShmBlock
+  {
+    uint32_t offset; // from the start of the slot
+    uint32_t size;   // bytes, 0 when the block is empty
+    uint32_t width;
+    uint32_t height;
+    uint32_t format; // ShmFormat
+    uint32_t reserved;
+  };
+
+  struct ShmRingHeader
+  {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t num_slots;
+    uint32_t slot_size;
+    uint32_t header_size;
+    std::atomic<uint64_t> last_seq; // last complete frame, 0 when none
+  };
+
+  struct ShmSlotHeader
+  {
+    std::atomic<uint64_t> lock; // seqlock, odd while the slot is written
+    uint64_t seq;
+    int64_t stamp_sec;
+    int64_t stamp_usec;
+    ShmBlock thermal; // SHM_MONO16, 160x120 raw counts
+    ShmBlock ir;      // SHM_MONO8 or SHM_RGB8
+    ShmBlock rgb;     // SHM_RGB8 or SHM_JPEG
+  };
+
+  class FlirOneShmWriter
+  {
+  public:
+    FlirOneShmWriter();
+    ~FlirOneShmWriter();
+
+    bool open(const std::string &name, unsigned int num_slots);
+    void close(void);
+    bool isOpen(void) const;
+
+    // copy the thermal, ir and rgb (decoded, or the jpeg bytes if jpeg is
+    // true) images of the frame in the next slot
+    void write(const FlirOneFrame &frame, bool jpeg);
+
+  private:
+    ShmSlotHeader *slot(uint64_t seq);
+
+    std::string name_;
+    int fd_;
+    unsigned char *base_;
+    size_t size_;
+    ShmRingHeader *header_;
+    uint64_t seq_;
+  };
+
+  class FlirOneShmReader
+  {
+  public:
+    FlirOneShmReader();
+    ~FlirOneShmReader();
+
+    bool attach(const std::string &name);
+    void detach(void);
+
+    // copy the newest complete frame in slot (ShmSlotHeader then data).
+    // Returns false when there is no frame newer than the last one read, or
+    // when the writer overwrote it during the copy (just try again).
+    bool readLatest(std::vector<unsigned char> &slot);
+
+    // true when not attached, or when the ring was closed or replaced by a
+    // restarted writer: detach and attach() again
+    bool stale(void) const;
+
+  private:
+    std::string name_;
+    dev_t dev_;
+    ino_t ino_;
+    int fd_;
+    unsigned char *base_;
+    size_t size_;
+    const ShmRingHeader *header_;
+    uint64_t last_seq_;
+  };
+};
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef FLIR_ONE_THERMAL_CODEC_H
+#define FLIR_ONE_THERMAL_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+/** @file
+
+    @brief Fast lossless codec for 16-bit thermal images.
+
+    Each pixel is predicted by the average of its left and upper neighbours
+    (the left one on the first row, the upper one on the first column). The zigzagged residuals are cut in blocks of
+    THERMAL_CODEC_BLOCK pixels, each stored with the smallest bit width that
+    holds all of them.
+
+    Format: "FT16", uint16 width, uint16 height (little-endian), then for
+    every pair of blocks one byte holding their width codes (low nibble
+    first, code 15 means 16 bits), followed by the packed residuals of the
+    two blocks (2 * width bytes each).
+*/
+#define THERMAL_CODEC_BLOCK 16
+
+namespace driver_flir
+{
+
+  // step: bytes between the starts of two rows
+  void encodeThermal(const uint16_t *pix, int width, int height, size_t step, std::vector<uint8_t> &out);
+
+  // returns false if data is not a valid encoded image
+  bool decodeThermal(const uint8_t *data, size_t size, std::vector<uint16_t> &pix, int &width, int &height);
+};
+
+#endif
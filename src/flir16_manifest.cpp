@@ -0,0 +1,7 @@
+#include <pluginlib/class_list_macros.h>
+
+#include "flir16_publisher.h"
+#include "flir16_subscriber.h"
+
+PLUGINLIB_EXPORT_CLASS(driver_flir::Flir16Publisher, image_transport::PublisherPlugin)
+PLUGINLIB_EXPORT_CLASS(driver_flir::Flir16Subscriber, image_transport::SubscriberPlugin)
@@ -0,0 +1,36 @@
+#include <sensor_msgs/image_encodings.h>
+
+#include "flir16_publisher.h"
+#include "flir_one_node/thermal_codec.h"
+
+namespace driver_flir
+{
+
+  void Flir16Publisher::publish(const sensor_msgs::Image &message, const PublishFn &publish_fn) const
+  {
+    if (message.encoding != sensor_msgs::image_encodings::MONO16 &&
+        message.encoding != sensor_msgs::image_encodings::TYPE_16UC1)
+    {
+      ROS_ERROR_THROTTLE(5.0, "flir16 transport only handles mono16/16UC1 images, got %s", message.encoding.c_str());
+      return;
+    }
+    if (message.width == 0 || message.height == 0 || message.data.empty())
+    {
+      return;
+    }
+    if (message.is_bigendian || message.width > 0xffff || message.height > 0xffff || message.step < 2 * message.width || message.data.size() < message.step * message.height)
+    {
+      ROS_ERROR_THROTTLE(5.0, "flir16 transport: unsupported image layout");
+      return;
+    }
+
+    sensor_msgs::CompressedImage compressed;
+
+    compressed.header = message.header;
+    // same convention as compressedDepth: "<raw encoding>; <transport>"
+    compressed.format = message.encoding + "; flir16";
+    encodeThermal(reinterpret_cast<const uint16_t *>(&message.data[0]), message.width, message.height, message.step, compressed.data);
+
+    publish_fn(compressed);
+  }
+};
@@ -0,0 +1,38 @@
+#include <string.h>
+
+#include <sensor_msgs/image_encodings.h>
+
+#include "flir16_subscriber.h"
+#include "flir_one_node/thermal_codec.h"
+
+namespace driver_flir
+{
+
+  void Flir16Subscriber::internalCallback(const sensor_msgs::CompressedImageConstPtr &message, const Callback &user_cb)
+  {
+    std::vector<uint16_t> pix;
+    int width, height;
+
+    if (message->data.empty() || !decodeThermal(&message->data[0], message->data.size(), pix, width, height))
+    {
+      ROS_ERROR_THROTTLE(5.0, "flir16 transport: could not decode image");
+      return;
+    }
+
+    sensor_msgs::ImagePtr image(new sensor_msgs::Image);
+
+    image->header = message->header;
+    image->encoding = message->format.substr(0, message->format.find(';'));
+    image->height = height;
+    image->width = width;
+    image->is_bigendian = false;
+    image->step = 2 * width;
+    image->data.resize(pix.size() * 2);
+    if (!pix.empty())
+    {
+      memcpy(&image->data[0], &pix[0], pix.size() * 2);
+    }
+
+    user_cb(image);
+  }
+};
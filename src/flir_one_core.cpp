@@ -0,0 +1,1153 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include <algorithm>
+#include <iostream>
+
+#include <libusb.h>
+
+#include <opencv2/highgui.hpp>
+#include <opencv2/imgproc.hpp>
+#include "flir_one_node/flir_one_core.h"
+
+//#define DEBUG_
+
+// Max & Min value used for scaling
+// (limits: -20° - +75° | 1600 - 5852)
+//
+// Theorical IR Sensor sensitivity : 0.1°C
+
+#define TEMP1 (-20.0)
+#define TEMP2 75.0
+#define VAL_TEMP1 1600.0
+#define VAL_TEMP2 5852.0
+
+// raw thermal value to celsius
+static inline float valToTemp(const float val)
+{
+  return static_cast<float>(TEMP1 + (TEMP2 - TEMP1) * (val - VAL_TEMP1) / (VAL_TEMP2 - VAL_TEMP1));
+}
+
+// celsius to raw thermal value
+static inline float tempToVal(const float temp)
+{
+  return static_cast<float>(VAL_TEMP1 + (VAL_TEMP2 - VAL_TEMP1) * (temp - TEMP1) / (TEMP2 - TEMP1));
+}
+
+// Smallest display range allowed in automatic range mode (~1 degC)
+#define AGC_MIN_SPAN 45.0
+
+using namespace std;
+
+namespace driver_flir
+{
+
+  FlirOneConfig::FlirOneConfig() : vendor_id(0x09cb),
+                                   product_id(0x1996),
+                                   min_temp(20.0),
+                                   max_temp(35.0),
+                                   ir_img_color(true),
+                                   ir_img_width(80),
+                                   ir_img_height(60),
+                                   auto_range(false),
+                                   agc_low_percentile(1.0),
+                                   agc_high_percentile(99.0),
+                                   agc_smoothing(0.1),
+                                   agc_hysteresis(0.2),
+                                   temporal_filter(false),
+                                   temporal_filter_shift(2),
+                                   temporal_filter_reset(1.0),
+                                   fusion_alpha(0.5),
+                                   fusion_homography((cv::Mat_<double>(3, 3) << 4.0, 0.0, 0.0, 0.0, 4.0, 0.0, 0.0, 0.0, 1.0))
+  {
+  }
+
+  FlirOneCore::FlirOneCore(const FlirOneConfig &config) : context(NULL),
+                                                          devh(NULL),
+                                                          ir_img_color(config.ir_img_color),
+                                                          ir_img_width(config.ir_img_width),
+                                                          ir_img_height(config.ir_img_height),
+                                                          auto_range(config.auto_range),
+                                                          agc_low_percentile(config.agc_low_percentile),
+                                                          agc_high_percentile(config.agc_high_percentile),
+                                                          agc_smoothing(config.agc_smoothing),
+                                                          agc_hysteresis(config.agc_hysteresis),
+                                                          agc_initialized_(false),
+                                                          temporal_filter(config.temporal_filter),
+                                                          temporal_filter_shift(std::max(0, std::min(8, config.temporal_filter_shift))),
+                                                          temporal_filter_reset(config.temporal_filter_reset),
+                                                          filter_initialized_(false),
+                                                          fusion_alpha(config.fusion_alpha),
+                                                          fusion_covered_(false),
+                                                          fusion_maps_valid_(false),
+                                                          outputs_(OUTPUT_RGB | OUTPUT_IR),
+                                                          states(INIT),
+                                                          setup_states(SETUP_INIT),
+                                                          isOk(true),
+                                                          fps_t(0),
+                                                          vendor_id(config.vendor_id),
+                                                          product_id(config.product_id)
+  {
+    //Heatbar properties
+    const int NUM_COLORS = 2;
+    float base_colors[NUM_COLORS][3] = {{1, 0, 0}, {0, 0, 1}}; //R,G,B. Any color will be interpolated among these values
+
+    setColors(base_colors, NUM_COLORS);
+
+    min_val = tempToVal(config.min_temp);
+    max_val = tempToVal(config.max_temp);
+    delta_val = max_val - min_val;
+
+    // large buffers live on the heap so that the core can be a local variable
+    buf.resize(1048576);
+    buf85.resize(BUF85SIZE);
+    agc_hist_.assign(AGC_HIST_BINS, 0);
+    filter_acc_.assign(160 * 120, 0);
+    pix_.resize(160 * 120);
+    memset(EP81_error, 0, sizeof(EP81_error));
+    memset(EP83_error, 0, sizeof(EP83_error));
+    memset(EP85_error, 0, sizeof(EP85_error));
+    gettimeofday(&t2, NULL);
+
+    for (size_t r = 0; r < config.rois.size(); r++)
+    {
+      const cv::Rect &rect = config.rois[r];
+      RoiAccumulator roi;
+
+      roi.x = std::max(0, std::min(159, rect.x));
+      roi.y = std::max(0, std::min(119, rect.y));
+      roi.width = std::max(1, std::min(160 - roi.x, rect.width));
+      roi.height = std::max(1, std::min(120 - roi.y, rect.height));
+      roi.max_x = roi.x;
+      roi.max_y = roi.y;
+      rois_.push_back(roi);
+    }
+
+    if (rois_.empty())
+    {
+      // whole frame: gives the hottest spot of the image
+      RoiAccumulator roi;
+      roi.x = 0;
+      roi.y = 0;
+      roi.width = 160;
+      roi.height = 120;
+      roi.max_x = 0;
+      roi.max_y = 0;
+      rois_.push_back(roi);
+    }
+
+    if (!setFusionHomography(config.fusion_homography))
+    {
+      setFusionHomography(FlirOneConfig().fusion_homography);
+    }
+
+    std::cout << "min_val:" << min_val << " max_val:" << max_val << " delta_val:" << delta_val << endl;
+  }
+
+  FlirOneCore::~FlirOneCore()
+  {
+    shutdown();
+  }
+
+  void FlirOneCore::shutdown()
+  {
+    if (devh != NULL)
+    {
+      libusb_reset_device(devh);
+      libusb_close(devh);
+      devh = NULL;
+    }
+    // only our own context, the host process may use the default one
+    if (context != NULL)
+    {
+      libusb_exit(context);
+      context = NULL;
+    }
+    isOk = false;
+  }
+
+  bool FlirOneCore::ok(void)
+  {
+    return isOk;
+  }
+
+  void FlirOneCore::getDisplayRange(float &min_temp, float &max_temp) const
+  {
+    min_temp = valToTemp(min_val);
+    max_temp = valToTemp(max_val);
+  }
+
+  void FlirOneCore::setFrameCallback(const FrameCallback &callback)
+  {
+    frame_callback_ = callback;
+  }
+
+  void FlirOneCore::setOutputs(unsigned int outputs)
+  {
+    outputs_ = outputs;
+  }
+
+  void FlirOneCore::print_bulk_result(const char ep[], char EP_error[], int r, int actual_length, unsigned char buf[])
+  {
+    time_t now1;
+    int i;
+
+    now1 = time(NULL);
+    if (r < 0)
+    {
+      if (strcmp(EP_error, libusb_error_name(r)) != 0)
+      {
+        strcpy(EP_error, libusb_error_name(r));
+        //fprintf(stderr, "\n: %s >>>>>>>>>>>>>>>>>bulk transfer (in) %s: %s\n", ctime(&now1), ep, libusb_error_name(r));
+        sleep(1);
+      }
+      //return 1;
+    }
+    else
+    {
+      //ROS_INFO("\n: %s bulk read EP %s, actual length %d\nHEX:\n", ctime(&now1), ep, actual_length);
+    }
+  }
+
+  void FlirOneCore::read(const char ep[], char EP_error[], int r, int actual_length, unsigned char buf[])
+  {
+    // reset buffer if the new chunk begins with magic bytes or the buffer size limit is exceeded
+    unsigned char magicbyte[4] = {0xEF, 0xBE, 0x00, 0x00};
+
+    if ((strncmp((const char *)buf, (const char *)magicbyte, 4) == 0) || ((buf85pointer + actual_length) >= BUF85SIZE))
+    {
+      buf85pointer = 0;
+    }
+
+    memmove(&buf85[buf85pointer], buf, actual_length);
+    buf85pointer = buf85pointer + actual_length;
+
+    if ((strncmp((const char *)&buf85[0], (const char *)magicbyte, 4) != 0))
+    {
+      buf85pointer = 0;
+      //printf("Reset buffer because of bad Magic Byte!\n");
+      return;
+    }
+
+    // a quick and dirty job for gcc
+    uint32_t FrameSize = buf85[8] + (buf85[9] << 8) + (buf85[10] << 16) + (buf85[11] << 24);
+
+    if ((FrameSize + 28) > (buf85pointer))
+    {
+      // wait for next chunk
+      //printf("wait for next chunk\n");
+      return;
+    }
+    // get a full frame, first print status
+    t1 = t2;
+    gettimeofday(&t2, NULL);
+    // fps as moving average over last 20 frames
+    fps_t = (19 * fps_t + 10000000 / (((t2.tv_sec * 1000000) + t2.tv_usec) - ((t1.tv_sec * 1000000) + t1.tv_usec))) / 20;
+
+#ifdef DEBUG_
+    printf("#%lld/10 fps:\n", fps_t);
+#endif
+    processFrame(&buf85[0], FrameSize + 28, t2);
+  }
+
+  void FlirOneCore::processFrame(const unsigned char *frame, size_t size, const struct timeval &stamp)
+  {
+    if (size < 28)
+    {
+      return;
+    }
+
+    uint32_t ThermalSize = frame[12] + (frame[13] << 8) + (frame[14] << 16) + (frame[15] << 24);
+    uint32_t JpgSize = frame[16] + (frame[17] << 8) + (frame[18] << 16) + (frame[19] << 24);
+    uint32_t StatusSize = frame[20] + (frame[21] << 8) + (frame[22] << 16) + (frame[23] << 24);
+    int v;
+
+#ifdef DEBUG_
+    printf("FrameSize %d\n", (int)size - 28);
+    printf("ThermalSize %d\n", ThermalSize);
+    printf("JpgSize %d\n", JpgSize);
+    printf("StatusSize %d\n", StatusSize);
+#endif
+    if (28 + static_cast<size_t>(ThermalSize) + JpgSize > size)
+    {
+      return;
+    }
+
+    bool do_rgb = outputs_ & OUTPUT_RGB;
+    bool do_ir = outputs_ & OUTPUT_IR;
+    bool do_roi = outputs_ & OUTPUT_ROI_STATS;
+    bool do_fused = outputs_ & OUTPUT_FUSED;
+    bool do_thermal = (outputs_ & OUTPUT_THERMAL) || do_ir || do_roi || do_fused;
+    bool do_agc = auto_range && (do_ir || do_fused);
+
+    frame_.outputs = 0;
+    frame_.stamp = stamp;
+    frame_.raw = frame;
+    frame_.raw_size = size;
+    frame_.jpeg = &frame[28 + ThermalSize];
+    frame_.jpeg_size = JpgSize;
+    frame_.rgb.release();
+    frame_.thermal.release();
+    frame_.ir.release();
+    frame_.fused.release();
+    frame_.rois.clear();
+
+    //RGB IMAGE
+    if (do_rgb || do_fused)
+    {
+      cv::Mat rawRgb = cv::Mat(1, JpgSize, CV_8UC1, const_cast<unsigned char *>(frame_.jpeg));
+      cv::Mat decodedImage = cv::imdecode(rawRgb, CV_LOAD_IMAGE_COLOR);
+      if (!decodedImage.empty())
+      {
+        cv::cvtColor(decodedImage, frame_.rgb, cv::COLOR_BGR2RGB);
+        frame_.outputs |= OUTPUT_RGB;
+      }
+    }
+
+    if (do_thermal && size >= 32 + 2 * 164 * 120)
+    {
+      unsigned short *pix = &pix_[0];
+      int v_min = 65535, v_max = 0;
+      // first filtered frame: a negative threshold resets every pixel
+      int32_t filter_reset_val = filter_initialized_ ? static_cast<int32_t>(temporal_filter_reset * (VAL_TEMP2 - VAL_TEMP1) / (TEMP2 - TEMP1)) << FILTER_FRAC_BITS : -1;
+
+      filter_initialized_ = temporal_filter;
+
+      if (do_roi)
+      {
+        for (size_t r = 0; r < rois_.size(); r++)
+        {
+          rois_[r].min = 65535;
+          rois_[r].max = 0;
+          rois_[r].sum = 0;
+        }
+      }
+
+      for (uint8_t y = 0; y < 120; ++y)
+      {
+        for (uint8_t x = 0; x < 160; ++x)
+        {
+          if (x < 80)
+          {
+            v = frame[2 * (y * 164 + x) + 32] + 256 * frame[2 * (y * 164 + x) + 33];
+          }
+          else
+          {
+            v = frame[2 * (y * 164 + x) + 32 + 4] + 256 * frame[2 * (y * 164 + x) + 33 + 4];
+          }
+          pix[y * 160 + x] = v; // unsigned char!!
+        }
+
+        if (temporal_filter)
+        {
+          filterRow(&pix[y * 160], &filter_acc_[y * 160], 160, filter_reset_val);
+        }
+
+        if (do_agc)
+        {
+          for (int x = 0; x < 160; ++x)
+          {
+            v = pix[y * 160 + x];
+            agc_hist_[v >> AGC_HIST_SHIFT]++;
+            if (v < v_min)
+              v_min = v;
+            if (v > v_max)
+              v_max = v;
+          }
+        }
+
+        // ROI statistics on the row just extracted (still in cache)
+        if (do_roi)
+        {
+          const unsigned short *row = &pix[y * 160];
+
+          for (size_t r = 0; r < rois_.size(); r++)
+          {
+            RoiAccumulator &roi = rois_[r];
+
+            if (y < roi.y || y >= roi.y + roi.height)
+              continue;
+
+            for (int x = roi.x; x < roi.x + roi.width; x++)
+            {
+              roi.sum += row[x];
+              if (row[x] < roi.min)
+                roi.min = row[x];
+              if (row[x] > roi.max)
+              {
+                roi.max = row[x];
+                roi.max_x = x;
+                roi.max_y = y;
+              }
+            }
+          }
+        }
+      }
+
+      frame_.thermal = cv::Mat(120, 160, CV_16UC1, pix);
+      frame_.outputs |= OUTPUT_THERMAL;
+
+      if (do_roi)
+      {
+        frame_.rois.resize(rois_.size());
+        for (size_t r = 0; r < rois_.size(); r++)
+        {
+          const RoiAccumulator &roi = rois_[r];
+          RoiStatistics &stats = frame_.rois[r];
+
+          stats.roi = cv::Rect(roi.x, roi.y, roi.width, roi.height);
+          stats.min_temp = valToTemp(roi.min);
+          stats.max_temp = valToTemp(roi.max);
+          stats.mean_temp = valToTemp(static_cast<float>(roi.sum) / (roi.width * roi.height));
+          stats.max_x = roi.max_x;
+          stats.max_y = roi.max_y;
+        }
+        frame_.outputs |= OUTPUT_ROI_STATS;
+      }
+
+      if (do_ir || do_fused)
+      {
+        if (do_agc)
+        {
+          // min_val/max_val/delta_val are replaced, the scaling below is unchanged
+          updateAutoRange(160 * 120, v_min, v_max);
+        }
+
+        if (do_ir)
+        {
+          thermalToImage(frame_.thermal, frame_.ir, ir_img_width, ir_img_height);
+          frame_.outputs |= OUTPUT_IR;
+        }
+
+        if (do_fused && !frame_.rgb.empty())
+        {
+          // the 80x60 ir image is a re-interleave, not a downscale: the
+          // homography is defined on the full 160x120 frame
+          if (do_ir && ir_img_width == 160 && ir_img_height == 120)
+          {
+            fusion_thermal_ = frame_.ir;
+          }
+          else
+          {
+            thermalToImage(frame_.thermal, fusion_thermal_, 160, 120);
+          }
+          fuse(frame_.rgb, fusion_thermal_, frame_.fused);
+          frame_.outputs |= OUTPUT_FUSED;
+        }
+      }
+    }
+    else
+    {
+      // the accumulator missed this frame, restart from the next one
+      filter_initialized_ = false;
+    }
+
+    if (frame_callback_)
+    {
+      frame_callback_(frame_);
+    }
+  }
+
+  void FlirOneCore::filterRow(unsigned short *__restrict row, int32_t *__restrict acc, const int width, const int32_t reset_val)
+  {
+    // Exponential moving average in fixed point (FILTER_FRAC_BITS fractional bits),
+    // weight of the new frame 1/2^temporal_filter_shift. Pixels that moved more than
+    // reset_val restart from the current value so that motion does not leave trails.
+    // The update is rounded so that small steps do not stick. Branchless so that
+    // the compiler vectorises it.
+    const int shift = temporal_filter_shift;
+    const int32_t half = shift > 0 ? 1 << (shift - 1) : 0;
+
+    for (int x = 0; x < width; x++)
+    {
+      int32_t in = static_cast<int32_t>(row[x]) << FILTER_FRAC_BITS;
+      int32_t d = in - acc[x];
+      int32_t ad = d < 0 ? -d : d;
+      int32_t out = ad > reset_val ? in : acc[x] + ((d + half) >> shift);
+
+      acc[x] = out;
+      row[x] = static_cast<unsigned short>((out + (1 << (FILTER_FRAC_BITS - 1))) >> FILTER_FRAC_BITS);
+    }
+  }
+
+  void FlirOneCore::thermalToImage(const cv::Mat &im16, cv::Mat &thermal_data, const int width, const int height)
+  {
+    if (ir_img_color)
+    {
+      thermal_data = cv::Mat(height, width, CV_8UC3, cv::Scalar(0, 0, 0));
+    }
+    else
+    {
+      thermal_data = cv::Mat(height, width, CV_8UC1);
+    }
+
+    for (int y = 0; y < height; y++)
+    {
+      for (int x = 0; x < width; x++)
+      {
+        if (ir_img_color)
+        {
+          float px_coef;
+          float red, green, blue;
+
+          if (width == 80) //80x60
+          {
+            if (y % 2)
+            { //odd
+              px_coef = (static_cast<float>(im16.at<uint16_t>(floor(y / 2), x + 80)) - min_val) / delta_val;
+            }
+            else
+            { //even
+              px_coef = (static_cast<float>(im16.at<uint16_t>(y / 2, x)) - min_val) / delta_val;
+            }
+          }
+          else
+          { //160x120
+            px_coef = (static_cast<float>(im16.at<uint16_t>(y, x)) - min_val) / delta_val;
+          }
+
+          if (px_coef < 0.0)
+            px_coef = 0.0;
+          else if (px_coef > 1.0)
+            px_coef = 1.0;
+
+          getHeatMapColorFromValue(px_coef, &red, &green, &blue);
+          thermal_data.at<cv::Vec3b>(y, x)[0] = static_cast<uint8_t>(blue * 255.0);
+          thermal_data.at<cv::Vec3b>(y, x)[1] = static_cast<uint8_t>(green * 255.0);
+          thermal_data.at<cv::Vec3b>(y, x)[2] = static_cast<uint8_t>(red * 255.0);
+        }
+        else
+        {
+          float pix_val;
+
+          if (width == 80) //80x60
+          {
+            if (y % 2)
+            { //odd
+              pix_val = 255.0 * (static_cast<float>(im16.at<uint16_t>(floor(y / 2), x + 80)) - min_val) / delta_val;
+            }
+            else
+            { //even
+              pix_val = 255.0 * (static_cast<float>(im16.at<uint16_t>(y / 2, x)) - min_val) / delta_val;
+            }
+          }
+          else
+          { //160x120
+            pix_val = 255.0 * (static_cast<float>(im16.at<uint16_t>(y, x)) - min_val) / delta_val;
+          }
+          if (pix_val < 0.0)
+            pix_val = 0.0;
+          else if (pix_val > 255.0)
+            pix_val = 255.0;
+          thermal_data.at<uint8_t>(y, x) = static_cast<uint8_t>(pix_val);
+        }
+      }
+    }
+  }
+
+  bool FlirOneCore::setFusionHomography(const cv::Mat &homography)
+  {
+    cv::Mat h;
+
+    if (homography.rows != 3 || homography.cols != 3 || homography.channels() != 1)
+    {
+      fprintf(stderr, "fusion_homography must be a 3x3 matrix, keeping the previous one\n");
+      return false;
+    }
+    homography.convertTo(h, CV_64F);
+    // a singular homography has no inverse: every visible pixel would sample thermal (0,0)
+    if (!cv::checkRange(h) || fabs(cv::determinant(h)) <= 1e-9 * pow(cv::norm(h), 3))
+    {
+      fprintf(stderr, "fusion_homography is singular or not finite, keeping the previous one\n");
+      return false;
+    }
+
+    fusion_homography_ = h;
+    fusion_maps_valid_ = false;
+    return true;
+  }
+
+  void FlirOneCore::buildFusionMaps(const cv::Size &size)
+  {
+    const cv::Rect frame_rect(cv::Point(0, 0), size);
+    const double corners[4][2] = {{0.0, 0.0}, {160.0, 0.0}, {0.0, 120.0}, {160.0, 120.0}};
+    const cv::Mat &g = fusion_homography_;
+    double x_min = size.width, y_min = size.height, x_max = 0.0, y_max = 0.0;
+
+    // bounding rect of the thermal footprint in the visible frame, only this
+    // part is remapped and blended. The whole frame if the footprint crosses
+    // the horizon of the homography.
+    fusion_rect_ = frame_rect;
+    for (int c = 0; c < 4; c++)
+    {
+      double w = g.at<double>(2, 0) * corners[c][0] + g.at<double>(2, 1) * corners[c][1] + g.at<double>(2, 2);
+
+      if (w <= 0.0)
+      {
+        x_min = 0.0;
+        y_min = 0.0;
+        x_max = size.width;
+        y_max = size.height;
+        break;
+      }
+      double x = (g.at<double>(0, 0) * corners[c][0] + g.at<double>(0, 1) * corners[c][1] + g.at<double>(0, 2)) / w;
+      double y = (g.at<double>(1, 0) * corners[c][0] + g.at<double>(1, 1) * corners[c][1] + g.at<double>(1, 2)) / w;
+
+      x_min = std::min(x_min, x);
+      y_min = std::min(y_min, y);
+      x_max = std::max(x_max, x);
+      y_max = std::max(y_max, y);
+    }
+    if (x_max > x_min && y_max > y_min)
+    {
+      cv::Point tl(static_cast<int>(std::max(0.0, floor(x_min))), static_cast<int>(std::max(0.0, floor(y_min))));
+      cv::Point br(static_cast<int>(std::min<double>(size.width, ceil(x_max))), static_cast<int>(std::min<double>(size.height, ceil(y_max))));
+
+      fusion_rect_ = cv::Rect(tl, br) & frame_rect;
+    }
+    else
+    {
+      fusion_rect_ = cv::Rect();
+    }
+
+    // visible pixel -> 160x120 thermal pixel
+    cv::Mat h = fusion_homography_.inv();
+    cv::Mat map_x(fusion_rect_.size(), CV_32FC1);
+    cv::Mat map_y(fusion_rect_.size(), CV_32FC1);
+
+    // when every pixel of the rect samples inside the thermal frame, the
+    // remap can write its output directly instead of over a visible copy
+    fusion_covered_ = true;
+    for (int y = 0; y < fusion_rect_.height; y++)
+    {
+      float *mx = map_x.ptr<float>(y);
+      float *my = map_y.ptr<float>(y);
+      const int vy = y + fusion_rect_.y;
+
+      for (int x = 0; x < fusion_rect_.width; x++)
+      {
+        const int vx = x + fusion_rect_.x;
+        double w = h.at<double>(2, 0) * vx + h.at<double>(2, 1) * vy + h.at<double>(2, 2);
+
+        w = (w != 0.0) ? 1.0 / w : 0.0;
+        mx[x] = static_cast<float>((h.at<double>(0, 0) * vx + h.at<double>(0, 1) * vy + h.at<double>(0, 2)) * w);
+        my[x] = static_cast<float>((h.at<double>(1, 0) * vx + h.at<double>(1, 1) * vy + h.at<double>(1, 2)) * w);
+        if (!(mx[x] >= 0.0f && mx[x] <= 159.0f && my[x] >= 0.0f && my[x] <= 119.0f))
+          fusion_covered_ = false;
+      }
+    }
+
+    // fixed-point maps: cheaper remap than the float ones
+    if (!fusion_rect_.empty())
+    {
+      cv::convertMaps(map_x, map_y, fusion_map1_, fusion_map2_, CV_16SC2);
+    }
+    fusion_map_size_ = size;
+    fusion_maps_valid_ = true;
+    printf("Fusion remap tables built for %dx%d, thermal footprint %dx%d at %d,%d\n", size.width, size.height,
+           fusion_rect_.width, fusion_rect_.height, fusion_rect_.x, fusion_rect_.y);
+  }
+
+  void FlirOneCore::fuse(const cv::Mat &visible, const cv::Mat &thermal_data, cv::Mat &fused)
+  {
+    const cv::Rect &r = fusion_rect_;
+    cv::Mat thermal_rgb;
+
+    if (!fusion_maps_valid_ || visible.size() != fusion_map_size_)
+    {
+      buildFusionMaps(visible.size());
+    }
+
+    // reused output buffer, see FlirOneFrame
+    fusion_fused_.create(visible.size(), visible.type());
+    fused = fusion_fused_;
+
+    if (r.empty())
+    {
+      visible.copyTo(fused);
+      return;
+    }
+
+    // pixels outside the thermal footprint rect keep the visible value
+    if (r.y > 0)
+      visible.rowRange(0, r.y).copyTo(fused.rowRange(0, r.y));
+    if (r.y + r.height < visible.rows)
+      visible.rowRange(r.y + r.height, visible.rows).copyTo(fused.rowRange(r.y + r.height, visible.rows));
+    if (r.x > 0)
+      visible(cv::Rect(0, r.y, r.x, r.height)).copyTo(fused(cv::Rect(0, r.y, r.x, r.height)));
+    if (r.x + r.width < visible.cols)
+    {
+      cv::Rect right(r.x + r.width, r.y, visible.cols - r.x - r.width, r.height);
+      visible(right).copyTo(fused(right));
+    }
+
+    if (thermal_data.channels() == 1)
+    {
+      cv::cvtColor(thermal_data, thermal_rgb, cv::COLOR_GRAY2RGB);
+    }
+    else
+    {
+      thermal_rgb = thermal_data;
+    }
+
+    if (fusion_covered_)
+    {
+      cv::remap(thermal_rgb, fusion_warp_, fusion_map1_, fusion_map2_, cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+    }
+    else
+    {
+      // pixels of the rect outside the footprint blend the visible value with itself
+      visible(r).copyTo(fusion_warp_);
+      cv::remap(thermal_rgb, fusion_warp_, fusion_map1_, fusion_map2_, cv::INTER_LINEAR, cv::BORDER_TRANSPARENT);
+    }
+    cv::Mat fused_rect = fused(r);
+    cv::addWeighted(visible(r), 1.0 - fusion_alpha, fusion_warp_, fusion_alpha, 0.0, fused_rect);
+  }
+
+  void FlirOneCore::updateAutoRange(const int num_pixels, const int v_min, const int v_max)
+  {
+    // Only the bins between the frame min and max were filled, so both the
+    // percentile search and the histogram reset stay within that span
+    const int bin_lo = v_min >> AGC_HIST_SHIFT;
+    const int bin_hi = v_max >> AGC_HIST_SHIFT;
+    const unsigned int below_target = static_cast<unsigned int>(num_pixels * agc_low_percentile / 100.0);
+    const unsigned int above_target = static_cast<unsigned int>(num_pixels * (100.0 - agc_high_percentile) / 100.0);
+    unsigned int cum;
+    int b;
+
+    // low percentile, walking up from the coldest bin
+    b = bin_lo;
+    cum = agc_hist_[b];
+    while (cum <= below_target && b < bin_hi)
+    {
+      cum += agc_hist_[++b];
+    }
+    float low = static_cast<float>(b << AGC_HIST_SHIFT);
+
+    // high percentile, walking down from the hottest bin
+    b = bin_hi;
+    cum = agc_hist_[b];
+    while (cum <= above_target && b > bin_lo)
+    {
+      cum += agc_hist_[--b];
+    }
+    float high = static_cast<float>((b + 1) << AGC_HIST_SHIFT);
+
+    memset(&agc_hist_[bin_lo], 0, (bin_hi - bin_lo + 1) * sizeof(agc_hist_[0]));
+
+    if (high - low < AGC_MIN_SPAN)
+    {
+      float center = 0.5 * (high + low);
+      low = center - 0.5 * AGC_MIN_SPAN;
+      high = center + 0.5 * AGC_MIN_SPAN;
+    }
+
+    if (!agc_initialized_)
+    {
+      agc_low_ = low;
+      agc_high_ = high;
+      agc_initialized_ = true;
+    }
+    else
+    {
+      // hysteresis: ignore changes smaller than agc_hysteresis (celsius), then smooth
+      const float hysteresis_val = agc_hysteresis * (VAL_TEMP2 - VAL_TEMP1) / (TEMP2 - TEMP1);
+
+      if (fabs(low - agc_low_) > hysteresis_val)
+        agc_low_ += agc_smoothing * (low - agc_low_);
+      if (fabs(high - agc_high_) > hysteresis_val)
+        agc_high_ += agc_smoothing * (high - agc_high_);
+    }
+
+    min_val = agc_low_;
+    max_val = agc_high_;
+    delta_val = max_val - min_val;
+  }
+
+  void FlirOneCore::getHeatMapColorFromValue(const float &value, float *red, float *green, float *blue)
+  {
+    float aux;
+    int idx1;               // |-- Our desired color will be between these two indexes in "color".
+    int idx2;               // |
+    float fractBetween = 0; // Fraction between "idx1" and "idx2" where our value is.
+    int num_base_colors;
+
+    num_base_colors = color_list_.size();
+
+    if (value <= 0)
+    {
+      idx1 = idx2 = 0;
+    } // accounts for an input <=0
+    else if (value >= 1)
+    {
+      idx1 = idx2 = num_base_colors - 1;
+    } // accounts for an input >=0
+    else
+    {
+      aux = value * (num_base_colors - 1); // Will multiply value by number of basic colors.
+      idx1 = floor(aux);                   // Our desired color will be after this index.
+      idx2 = idx1 + 1;                     // ... and before this index (inclusive).
+      fractBetween = aux - float(idx1);    // Distance between the two indexes (0-1).
+    }
+
+    *red = (color_list_[idx2][0] - color_list_[idx1][0]) * fractBetween + color_list_[idx1][0];
+    *green = (color_list_[idx2][1] - color_list_[idx1][1]) * fractBetween + color_list_[idx1][1];
+    *blue = (color_list_[idx2][2] - color_list_[idx1][2]) * fractBetween + color_list_[idx1][2];
+  }
+
+  void FlirOneCore::setColors(float color_list[][3], const int num_base_colors)
+  {
+    for (int c = 0; c < num_base_colors; c++)
+    {
+      vector<float> basic_color;
+
+      for (int ch = 0; ch < 3; ch++)
+      {
+        basic_color.push_back(color_list[c][ch]);
+      }
+      color_list_.push_back(basic_color);
+    }
+  }
+
+  void FlirOneCore::poll(void)
+  {
+    unsigned char data[2] = {0, 0}; // only a bad dummy
+    int r = 0;
+    time_t now;
+
+    switch (states)
+    {
+      /* Flir config
+      01 0b 01 00 01 00 00 00 c4 d5
+      0 bmRequestType = 01
+      1 bRequest = 0b
+      2 wValue 0001 type (H) index (L)    stop=0/start=1 (Alternate Setting)
+      4 wIndex 01                         interface 1/2
+      5 wLength 00
+      6 Data 00 00
+
+      libusb_control_transfer (*dev_handle, bmRequestType, bRequest, wValue,  wIndex, *data, wLength, timeout)
+      */
+
+    case INIT:
+      //ROS_INFO("stop interface 2 FRAME\n");
+      r = libusb_control_transfer(devh, 1, 0x0b, 0, 2, data, 0, 100);
+      if (r < 0)
+      {
+        //ROS_ERROR("Control Out error %d\n", r);
+        error_code = r;
+        states = ERROR;
+      }
+      else
+      {
+        states = INIT_1;
+      }
+      break;
+
+    case INIT_1:
+      //ROS_INFO("stop interface 1 FILEIO\n");
+      r = libusb_control_transfer(devh, 1, 0x0b, 0, 1, data, 0, 100);
+      if (r < 0)
+      {
+        //ROS_ERROR("Control Out error %d\n", r);
+        error_code = r;
+        states = ERROR;
+      }
+      else
+      {
+        states = INIT_2;
+      }
+      break;
+
+    case INIT_2:
+      //ROS_INFO("\nstart interface 1 FILEIO\n");
+      r = libusb_control_transfer(devh, 1, 0x0b, 1, 1, data, 0, 100);
+      if (r < 0)
+      {
+        //ROS_ERROR("Control Out error %d\n", r);
+        error_code = r;
+        states = ERROR;
+      }
+      else
+      {
+        states = ASK_ZIP;
+      }
+      break;
+
+    case ASK_ZIP:
+    {
+      //ROS_INFO("\nask for CameraFiles.zip on EP 0x83:\n");
+      now = time(0); // Get the system time
+      //ROS_INFO("\n: %s", ctime(&now));
+
+      int transferred = 0;
+      char my_string[128];
+
+      //--------- write string: {"type":"openFile","data":{"mode":"r","path":"CameraFiles.zip"}}
+      int length = 16;
+      unsigned char my_string2[16] = {0xcc, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x41, 0x00, 0x00, 0x00, 0xF8, 0xB3, 0xF7, 0x00};
+      //ROS_INFO("\nEP 0x02 to be sent Hexcode: %i Bytes[", length);
+      //int i;
+      //for (i = 0; i < length; i++)
+      //{
+      //ROS_INFO(" %02x", my_string2[i]);
+      //}
+      //ROS_INFO(" ]\n");
+
+      r = libusb_bulk_transfer(devh, 2, my_string2, length, &transferred, 0);
+      if (r == 0 && transferred == length)
+      {
+        printf("\nWrite successful!\n");
+      }
+      else
+      {
+        //ROS_ERROR("\nError in write! res = %d and transferred = %d\n", r, transferred);
+      }
+
+      strcpy(my_string, "{\"type\":\"openFile\",\"data\":{\"mode\":\"r\",\"path\":\"CameraFiles.zip\"}}");
+
+      length = strlen(my_string) + 1;
+      //ROS_INFO("\nEP 0x02 to be sent: %s", my_string);
+
+      // avoid error: invalid conversion from ‘char*’ to ‘unsigned char*’ [-fpermissive]
+      unsigned char *my_string1 = (unsigned char *)my_string;
+      //my_string1 = (unsigned char*)my_string;
+
+      r = libusb_bulk_transfer(devh, 2, my_string1, length, &transferred, 0);
+      if (r == 0 && transferred == length)
+      {
+        printf("\nWrite successful!\n");
+        //ROS_INFO("\nSent %d bytes with string: %s\n", transferred, my_string);
+      }
+      else
+      {
+        //ROS_ERROR("\nError in write! res = %d and transferred = %d\n", r, transferred);
+      }
+
+      //--------- write string: {"type":"readFile","data":{"streamIdentifier":10}}
+      length = 16;
+      unsigned char my_string3[16] = {0xcc, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x33, 0x00, 0x00, 0x00, 0xef, 0xdb, 0xc1, 0xc1};
+      //ROS_INFO("\nEP 0x02 to be sent Hexcode: %i Bytes[", length);
+      //for (i = 0; i < length; i++)
+      //{
+      //  ROS_INFO(" %02x", my_string3[i]);
+      //}
+      //ROS_INFO(" ]\n");
+
+      r = libusb_bulk_transfer(devh, 2, my_string3, length, &transferred, 0);
+      if (r == 0 && transferred == length)
+      {
+        printf("\nWrite successful!\n");
+      }
+      else
+      {
+        //ROS_ERROR("\nError in write! res = %d and transferred = %d\n", r, transferred);
+      }
+
+      //strcpy(  my_string, "{\"type\":\"setOption\",\"data\":{\"option\":\"autoFFC\",\"value\":true}}");
+      strcpy(my_string, "{\"type\":\"readFile\",\"data\":{\"streamIdentifier\":10}}");
+      length = strlen(my_string) + 1;
+      //ROS_INFO("\nEP 0x02 to be sent %i Bytes: %s", length, my_string);
+
+      // avoid error: invalid conversion from ‘char*’ to ‘unsigned char*’ [-fpermissive]
+      my_string1 = (unsigned char *)my_string;
+
+      r = libusb_bulk_transfer(devh, 2, my_string1, length, &transferred, 0);
+      if (r == 0 && transferred == length)
+      {
+        printf("\nWrite successful!\n");
+        //ROS_INFO("\nSent %d bytes with string: %s\n", transferred, my_string);
+      }
+      else
+      {
+        //ROS_ERROR("\nError in write! res = %d and transferred = %d\n", r, transferred);
+      }
+
+      // go to next state
+      now = time(0); // Get the system time
+      printf("\n: %s\n", ctime(&now));
+      //sleep(1);
+      states = ASK_VIDEO;
+    }
+    break;
+
+    case ASK_VIDEO:
+      //ROS_INFO("\nAsk for video stream, start EP 0x85:\n");
+
+      r = libusb_control_transfer(devh, 1, 0x0b, 1, 2, data, 2, 200);
+      if (r < 0)
+      {
+        //ROS_ERROR("Control Out error %d\n", r);
+        error_code = r;
+        states = ERROR;
+      }
+      else
+      {
+        states = POOL_FRAME;
+      }
+      break;
+
+    case POOL_FRAME:
+    {
+      // endless loop
+      // poll Frame Endpoints 0x85
+      // don't change timeout=100ms !!
+      r = libusb_bulk_transfer(devh, 0x85, &buf[0], buf.size(), &actual_length, 200);
+      switch (r)
+      {
+      case LIBUSB_ERROR_TIMEOUT:
+        //ROS_ERROR("LIBUSB_ERROR_TIMEOUT");
+        break;
+      case LIBUSB_ERROR_PIPE:
+        //ROS_ERROR("LIBUSB_ERROR_PIPE");
+        break;
+      case LIBUSB_ERROR_OVERFLOW:
+        //ROS_ERROR("LIBUSB_ERROR_OVERFLOW");
+        break;
+      case LIBUSB_ERROR_NO_DEVICE:
+        //ROS_ERROR("LIBUSB_ERROR_NO_DEVICE");
+        break;
+      }
+      if (actual_length > 0)
+      {
+        //ROS_INFO("T'es une FRAME %d", actual_length);
+        read("0x85", EP85_error, r, actual_length, &buf[0]);
+      }
+    }
+    break;
+
+    case ERROR:
+      isOk = false;
+      break;
+    }
+
+    // poll Endpoints 0x81, 0x83
+    r = libusb_bulk_transfer(devh, 0x81, &buf[0], buf.size(), &actual_length, 10);
+    print_bulk_result("0x81", EP81_error, r, actual_length, &buf[0]);
+
+    r = libusb_bulk_transfer(devh, 0x83, &buf[0], buf.size(), &actual_length, 10);
+    print_bulk_result("0x83", EP83_error, r, actual_length, &buf[0]);
+  }
+
+  void FlirOneCore::setup(void)
+  {
+
+    do
+    {
+      switch (setup_states)
+      {
+      case SETUP_INIT:
+        if (libusb_init(&context) < 0)
+        {
+          //ROS_ERROR("failed to initialise libusb");
+          setup_states = SETUP_ERROR;
+        }
+        else
+        {
+          //ROS_INFO("Successfully initialise libusb");
+          setup_states = SETUP_FIND;
+          setup_states = SETUP_LISTING;
+        }
+        break;
+
+      case SETUP_LISTING:
+      {
+        int rc = 0;
+        libusb_device_handle *dev_handle = NULL;
+        libusb_device **devs;
+        int count = libusb_get_device_list(context, &devs);
+
+        for (size_t idx = 0; idx < count; ++idx)
+        {
+          libusb_device *device = devs[idx];
+          libusb_device_descriptor desc = {0};
+
+          rc = libusb_get_device_descriptor(device, &desc);
+          assert(rc == 0);
+
+          //printf("Vendor:Device = %04x:%04x\n", desc.idVendor, desc.idProduct);
+        }
+        libusb_free_device_list(devs, 1); //free the list, unref the devices in it
+        setup_states = SETUP_FIND;
+      }
+      break;
+
+      case SETUP_FIND:
+        devh = libusb_open_device_with_vid_pid(context, vendor_id, product_id);
+        if (devh == NULL)
+        {
+          //ROS_ERROR_STREAM("Could not find/open device. devh : " << devh);
+          setup_states = SETUP_ERROR;
+        }
+        else
+        {
+          printf("Successfully find the Flir One G2 device\n");
+          setup_states = SETUP_SET_CONF;
+        }
+        break;
+
+      case SETUP_SET_CONF:
+        //ROS_INFO("A Live");
+        if (int r = libusb_set_configuration(devh, 3) < 0)
+        {
+          //ROS_ERROR("libusb_set_configuration error %d", r);
+          setup_states = SETUP_ERROR;
+        }
+        else
+        {
+          printf("Successfully set usb configuration 3\n");
+          setup_states = SETUP_CLAIM_INTERFACE_0;
+        }
+        break;
+
+      case SETUP_CLAIM_INTERFACE_0:
+        if (int r = libusb_claim_interface(devh, 0) < 0)
+        {
+          //ROS_ERROR("libusb_claim_interface 0 error %d", r);
+          setup_states = SETUP_ERROR;
+        }
+        else
+        {
+          printf("Successfully claimed interface 1\n");
+          setup_states = SETUP_CLAIM_INTERFACE_1;
+        }
+        break;
+
+      case SETUP_CLAIM_INTERFACE_1:
+        if (int r = libusb_claim_interface(devh, 1) < 0)
+        {
+          //ROS_ERROR("libusb_claim_interface 1 error %d", r);
+          setup_states = SETUP_ERROR;
+        }
+        else
+        {
+          printf("Successfully claimed interface 1\n");
+          setup_states = SETUP_CLAIM_INTERFACE_2;
+        }
+        break;
+
+      case SETUP_CLAIM_INTERFACE_2:
+        if (int r = libusb_claim_interface(devh, 2) < 0)
+        {
+          //ROS_ERROR("libusb_claim_interface 2 error %d", r);
+          setup_states = SETUP_ERROR;
+        }
+        else
+        {
+          printf("Successfully claimed interface 2\n");
+          setup_states = SETUP_ALL_OK;
+        }
+        break;
+      }
+    } while ((setup_states != SETUP_ERROR) && (setup_states != SETUP_ALL_OK));
+
+    if (setup_states == SETUP_ERROR)
+    {
+      shutdown();
+    }
+  }
+};
+
@@ -0,0 +1,17 @@
+#include "driver_flir.h"
+
+// Decodes the raw/frame topic published by flir_one_node in raw_only mode
+// (live or from a bag) into the usual rgb/ir/fused/roi_stats outputs.
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "flir_one_decoder_node");
+  ros::NodeHandle node;
+  ros::NodeHandle priv_nh("~");
+  ros::NodeHandle camera_nh("~");
+  driver_flir::DriverFlir dvr(node, priv_nh, camera_nh);
+
+  dvr.subscribeRaw();
+  ros::spin();
+
+  return 0;
+}
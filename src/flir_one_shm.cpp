@@ -0,0 +1,307 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include "flir_one_node/flir_one_shm.h"
+
+// blocks are 8-byte aligned inside a slot
+#define SHM_ALIGN(x) (((x) + 7) & ~static_cast<size_t>(7))
+
+#define SHM_THERMAL_OFFSET SHM_ALIGN(sizeof(driver_flir::ShmSlotHeader))
+#define SHM_IR_OFFSET (SHM_THERMAL_OFFSET + SHM_ALIGN(SHM_THERMAL_SIZE))
+#define SHM_RGB_OFFSET (SHM_IR_OFFSET + SHM_ALIGN(SHM_IR_SIZE))
+#define SHM_SLOT_SIZE (SHM_RGB_OFFSET + SHM_ALIGN(SHM_RGB_SIZE))
+
+namespace driver_flir
+{
+
+  // the seqlock words are shared between processes, they must not use a hidden lock
+  static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "64-bit atomics must always be lock-free");
+  static_assert(sizeof(std::atomic<uint64_t>) == 8, "shared atomics must be plain 64-bit words");
+
+  // copy a continuous image in a slot block, the block is left empty if it does not fit
+  static void writeBlock(unsigned char *slot_base, ShmBlock &block, const cv::Mat &image, uint32_t format, size_t capacity)
+  {
+    size_t size = image.total() * image.elemSize();
+
+    block.size = 0;
+    block.width = image.cols;
+    block.height = image.rows;
+    block.format = format;
+    if (image.empty() || !image.isContinuous() || size > capacity)
+    {
+      return;
+    }
+    memcpy(slot_base + block.offset, image.data, size);
+    block.size = size;
+  }
+
+  FlirOneShmWriter::FlirOneShmWriter() : fd_(-1),
+                                         base_(NULL),
+                                         size_(0),
+                                         header_(NULL),
+                                         seq_(0)
+  {
+  }
+
+  FlirOneShmWriter::~FlirOneShmWriter()
+  {
+    close();
+  }
+
+  bool FlirOneShmWriter::open(const std::string &name, unsigned int num_slots)
+  {
+    close();
+
+    num_slots = std::max(1u, num_slots);
+    size_ = SHM_ALIGN(sizeof(ShmRingHeader)) + num_slots * SHM_SLOT_SIZE;
+
+    fd_ = shm_open(name.c_str(), O_CREAT | O_RDWR, 0666);
+    if (fd_ < 0)
+    {
+      perror("shm_open");
+      return false;
+    }
+    if (ftruncate(fd_, size_) < 0)
+    {
+      perror("ftruncate");
+      close();
+      return false;
+    }
+    void *base = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (base == MAP_FAILED)
+    {
+      perror("mmap");
+      close();
+      return false;
+    }
+    base_ = static_cast<unsigned char *>(base);
+    name_ = name;
+
+    // readers check the magic, write it last
+    header_ = reinterpret_cast<ShmRingHeader *>(base_);
+    header_->magic = 0;
+    std::atomic_thread_fence(std::memory_order_release);
+    memset(base_ + sizeof(uint64_t), 0, size_ - sizeof(uint64_t));
+    header_->version = SHM_VERSION;
+    header_->num_slots = num_slots;
+    header_->slot_size = SHM_SLOT_SIZE;
+    header_->header_size = SHM_ALIGN(sizeof(ShmRingHeader));
+    header_->last_seq.store(0, std::memory_order_relaxed);
+    for (unsigned int i = 0; i < num_slots; i++)
+    {
+      ShmSlotHeader *s = slot(i + 1);
+
+      s->thermal.offset = SHM_THERMAL_OFFSET;
+      s->ir.offset = SHM_IR_OFFSET;
+      s->rgb.offset = SHM_RGB_OFFSET;
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    header_->magic = SHM_MAGIC;
+    seq_ = 0;
+
+    printf("Shared memory ring /dev/shm%s: %u slots of %u bytes\n", name.c_str(), num_slots, header_->slot_size);
+    return true;
+  }
+
+  void FlirOneShmWriter::close(void)
+  {
+    if (base_ != NULL)
+    {
+      // tells attached readers that this ring is gone
+      std::atomic_thread_fence(std::memory_order_release);
+      header_->magic = 0;
+      munmap(base_, size_);
+      base_ = NULL;
+      header_ = NULL;
+    }
+    if (fd_ >= 0)
+    {
+      ::close(fd_);
+      fd_ = -1;
+      shm_unlink(name_.c_str());
+    }
+  }
+
+  bool FlirOneShmWriter::isOpen(void) const
+  {
+    return base_ != NULL;
+  }
+
+  ShmSlotHeader *FlirOneShmWriter::slot(uint64_t seq)
+  {
+    return reinterpret_cast<ShmSlotHeader *>(base_ + header_->header_size + ((seq - 1) % header_->num_slots) * header_->slot_size);
+  }
+
+  void FlirOneShmWriter::write(const FlirOneFrame &frame, bool jpeg)
+  {
+    if (!isOpen())
+    {
+      return;
+    }
+
+    uint64_t seq = ++seq_;
+    ShmSlotHeader *s = slot(seq);
+    unsigned char *slot_base = reinterpret_cast<unsigned char *>(s);
+
+    s->lock.store(2 * seq - 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    s->seq = seq;
+    s->stamp_sec = frame.stamp.tv_sec;
+    s->stamp_usec = frame.stamp.tv_usec;
+
+    writeBlock(slot_base, s->thermal, (frame.outputs & OUTPUT_THERMAL) ? frame.thermal : cv::Mat(), SHM_MONO16, SHM_THERMAL_SIZE);
+    writeBlock(slot_base, s->ir, (frame.outputs & OUTPUT_IR) ? frame.ir : cv::Mat(),
+               frame.ir.channels() == 3 ? SHM_RGB8 : SHM_MONO8, SHM_IR_SIZE);
+    if (jpeg)
+    {
+      s->rgb.width = 0;
+      s->rgb.height = 0;
+      s->rgb.format = SHM_JPEG;
+      s->rgb.size = 0;
+      if (frame.jpeg != NULL && frame.jpeg_size <= SHM_RGB_SIZE)
+      {
+        memcpy(slot_base + s->rgb.offset, frame.jpeg, frame.jpeg_size);
+        s->rgb.size = frame.jpeg_size;
+      }
+    }
+    else
+    {
+      writeBlock(slot_base, s->rgb, (frame.outputs & OUTPUT_RGB) ? frame.rgb : cv::Mat(), SHM_RGB8, SHM_RGB_SIZE);
+    }
+
+    s->lock.store(2 * seq, std::memory_order_release);
+    header_->last_seq.store(seq, std::memory_order_release);
+  }
+
+  FlirOneShmReader::FlirOneShmReader() : dev_(0),
+                                         ino_(0),
+                                         fd_(-1),
+                                         base_(NULL),
+                                         size_(0),
+                                         header_(NULL),
+                                         last_seq_(0)
+  {
+  }
+
+  FlirOneShmReader::~FlirOneShmReader()
+  {
+    detach();
+  }
+
+  bool FlirOneShmReader::attach(const std::string &name)
+  {
+    struct stat st;
+
+    detach();
+
+    fd_ = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd_ < 0 || fstat(fd_, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(ShmRingHeader))
+    {
+      detach();
+      return false;
+    }
+    size_ = st.st_size;
+    dev_ = st.st_dev;
+    ino_ = st.st_ino;
+    void *base = mmap(NULL, size_, PROT_READ, MAP_SHARED, fd_, 0);
+    if (base == MAP_FAILED)
+    {
+      detach();
+      return false;
+    }
+    base_ = static_cast<unsigned char *>(base);
+    header_ = reinterpret_cast<const ShmRingHeader *>(base_);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (header_->magic != SHM_MAGIC || header_->version != SHM_VERSION ||
+        header_->header_size + static_cast<size_t>(header_->num_slots) * header_->slot_size > size_)
+    {
+      detach();
+      return false;
+    }
+    name_ = name;
+    last_seq_ = 0;
+    return true;
+  }
+
+  void FlirOneShmReader::detach(void)
+  {
+    if (base_ != NULL)
+    {
+      munmap(base_, size_);
+      base_ = NULL;
+      header_ = NULL;
+    }
+    if (fd_ >= 0)
+    {
+      close(fd_);
+      fd_ = -1;
+    }
+  }
+
+  bool FlirOneShmReader::stale(void) const
+  {
+    struct stat st;
+
+    if (base_ == NULL || header_->magic != SHM_MAGIC)
+    {
+      return true;
+    }
+
+    // a writer that died without closing leaves the magic, but a restarted
+    // one has created a new object under the same name
+    int fd = shm_open(name_.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+    {
+      return true;
+    }
+    bool replaced = fstat(fd, &st) < 0 || st.st_dev != dev_ || st.st_ino != ino_;
+    close(fd);
+    return replaced;
+  }
+
+  bool FlirOneShmReader::readLatest(std::vector<unsigned char> &slot)
+  {
+    if (base_ == NULL)
+    {
+      return false;
+    }
+
+    uint64_t seq = header_->last_seq.load(std::memory_order_acquire);
+    if (seq == 0 || seq == last_seq_)
+    {
+      return false;
+    }
+
+    const unsigned char *slot_base = base_ + header_->header_size + ((seq - 1) % header_->num_slots) * header_->slot_size;
+    const ShmSlotHeader *s = reinterpret_cast<const ShmSlotHeader *>(slot_base);
+
+    uint64_t lock = s->lock.load(std::memory_order_acquire);
+    if (lock != 2 * seq)
+    {
+      return false;
+    }
+
+    // only copy up to the end of the last filled block
+    size_t used = std::max(std::max(s->thermal.offset + s->thermal.size, s->ir.offset + s->ir.size), s->rgb.offset + s->rgb.size);
+    used = std::min(std::max(used, sizeof(ShmSlotHeader)), static_cast<size_t>(header_->slot_size));
+    slot.resize(used);
+    memcpy(&slot[0], slot_base, used);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (s->lock.load(std::memory_order_relaxed) != lock)
+    {
+      return false;
+    }
+    last_seq_ = seq;
+    return true;
+  }
+};
@@ -0,0 +1,233 @@
+#include <string.h>
+
+#include "flir_one_node/thermal_codec.h"
+
+#define HEADER_SIZE 8
+
+namespace driver_flir
+{
+
+  // residuals are taken modulo 2^16 so that they always fit 16 bits
+  static inline uint16_t zigzag(uint16_t a, uint16_t b)
+  {
+    uint32_t v = static_cast<uint16_t>(a - b);
+
+    return static_cast<uint16_t>((v << 1) ^ -(v >> 15));
+  }
+
+  static inline uint16_t unzigzag(uint16_t v)
+  {
+    return static_cast<uint16_t>((v >> 1) ^ -(v & 1));
+  }
+
+  // average of the left and upper pixels: on sensor noise the residual
+  // variance is 1.5 times the pixel one, against 2 times with a single neighbour
+  static inline uint16_t predict(uint16_t left, uint16_t up)
+  {
+    return static_cast<uint16_t>((static_cast<uint32_t>(left) + up + 1) >> 1);
+  }
+
+  static inline int widthCode(uint16_t bits)
+  {
+    int n = 0;
+
+    while (bits >> n)
+      n++;
+    return n == 16 ? 15 : n;
+  }
+
+  static inline int codeBits(int code)
+  {
+    return code == 15 ? 16 : code;
+  }
+
+  // 16 values of nbits bits = 2 * nbits bytes
+  static inline uint8_t *packBlock(const uint16_t *v, int nbits, uint8_t *out)
+  {
+    uint32_t acc = 0;
+    int filled = 0;
+
+    for (int i = 0; i < THERMAL_CODEC_BLOCK; i++)
+    {
+      acc |= static_cast<uint32_t>(v[i]) << filled;
+      filled += nbits;
+      while (filled >= 8)
+      {
+        *out++ = static_cast<uint8_t>(acc);
+        acc >>= 8;
+        filled -= 8;
+      }
+    }
+    return out;
+  }
+
+  static inline const uint8_t *unpackBlock(const uint8_t *in, int nbits, uint16_t *v)
+  {
+    const uint32_t mask = (1u << nbits) - 1;
+    uint32_t acc = 0;
+    int filled = 0;
+
+    for (int i = 0; i < THERMAL_CODEC_BLOCK; i++)
+    {
+      while (filled < nbits)
+      {
+        acc |= static_cast<uint32_t>(*in++) << filled;
+        filled += 8;
+      }
+      v[i] = static_cast<uint16_t>(acc & mask);
+      acc >>= nbits;
+      filled -= nbits;
+    }
+    return in;
+  }
+
+  void encodeThermal(const uint16_t *pix, int width, int height, size_t step, std::vector<uint8_t> &out)
+  {
+    // an empty image is encoded as a bare 0x0 header
+    if (width <= 0 || height <= 0)
+    {
+      width = 0;
+      height = 0;
+    }
+
+    const size_t n = static_cast<size_t>(width) * height;
+    const size_t num_blocks = (n + THERMAL_CODEC_BLOCK - 1) / THERMAL_CODEC_BLOCK;
+    std::vector<uint16_t> res(num_blocks * THERMAL_CODEC_BLOCK, 0);
+
+    // residuals, the row loops are branchless so that they vectorise
+    for (int y = 0; y < height; y++)
+    {
+      const uint16_t *row = reinterpret_cast<const uint16_t *>(reinterpret_cast<const uint8_t *>(pix) + y * step);
+      uint16_t *r = &res[static_cast<size_t>(y) * width];
+
+      if (y == 0)
+      {
+        r[0] = zigzag(row[0], 0);
+        for (int x = 1; x < width; x++)
+          r[x] = zigzag(row[x], row[x - 1]);
+      }
+      else
+      {
+        const uint16_t *above = reinterpret_cast<const uint16_t *>(reinterpret_cast<const uint8_t *>(row) - step);
+
+        r[0] = zigzag(row[0], above[0]);
+        for (int x = 1; x < width; x++)
+          r[x] = zigzag(row[x], predict(row[x - 1], above[x]));
+      }
+    }
+
+    // worst case: 16 bits per pixel plus one nibble per block
+    out.resize(HEADER_SIZE + (num_blocks + 1) / 2 + num_blocks * 2 * THERMAL_CODEC_BLOCK);
+    uint8_t *p = &out[0];
+
+    memcpy(p, "FT16", 4);
+    p[4] = width & 0xff;
+    p[5] = width >> 8;
+    p[6] = height & 0xff;
+    p[7] = height >> 8;
+    p += HEADER_SIZE;
+
+    for (size_t b = 0; b < num_blocks; b += 2)
+    {
+      int codes[2] = {0, 0};
+
+      for (size_t k = 0; k < 2 && b + k < num_blocks; k++)
+      {
+        const uint16_t *v = &res[(b + k) * THERMAL_CODEC_BLOCK];
+        uint16_t bits = 0;
+
+        for (int i = 0; i < THERMAL_CODEC_BLOCK; i++)
+          bits |= v[i];
+        codes[k] = widthCode(bits);
+      }
+
+      *p++ = static_cast<uint8_t>(codes[0] | (codes[1] << 4));
+      for (size_t k = 0; k < 2 && b + k < num_blocks; k++)
+      {
+        p = packBlock(&res[(b + k) * THERMAL_CODEC_BLOCK], codeBits(codes[k]), p);
+      }
+    }
+
+    out.resize(p - &out[0]);
+  }
+
+  bool decodeThermal(const uint8_t *data, size_t size, std::vector<uint16_t> &pix, int &width, int &height)
+  {
+    if (size < HEADER_SIZE || memcmp(data, "FT16", 4) != 0)
+    {
+      return false;
+    }
+    width = data[4] | (data[5] << 8);
+    height = data[6] | (data[7] << 8);
+
+    // the encoder writes empty images as 0x0
+    if ((width == 0) != (height == 0))
+    {
+      return false;
+    }
+
+    const size_t n = static_cast<size_t>(width) * height;
+    const size_t num_blocks = (n + THERMAL_CODEC_BLOCK - 1) / THERMAL_CODEC_BLOCK;
+    const uint8_t *p = data + HEADER_SIZE;
+
+    if (n == 0)
+    {
+      pix.clear();
+      return true;
+    }
+    const uint8_t *end = data + size;
+
+    // at least one byte per pair of blocks, rejects absurd sizes before allocating
+    if (num_blocks > 2 * size)
+    {
+      return false;
+    }
+    std::vector<uint16_t> res(num_blocks * THERMAL_CODEC_BLOCK);
+
+    for (size_t b = 0; b < num_blocks; b += 2)
+    {
+      if (p >= end)
+      {
+        return false;
+      }
+
+      int codes[2] = {*p & 0x0f, *p >> 4};
+      p++;
+
+      for (size_t k = 0; k < 2 && b + k < num_blocks; k++)
+      {
+        int nbits = codeBits(codes[k]);
+
+        if (end - p < 2 * nbits)
+        {
+          return false;
+        }
+        p = unpackBlock(p, nbits, &res[(b + k) * THERMAL_CODEC_BLOCK]);
+      }
+    }
+
+    pix.resize(n);
+    for (int y = 0; y < height; y++)
+    {
+      const uint16_t *r = &res[static_cast<size_t>(y) * width];
+      uint16_t *row = &pix[static_cast<size_t>(y) * width];
+
+      if (y == 0)
+      {
+        if (width > 0)
+          row[0] = unzigzag(r[0]);
+        for (int x = 1; x < width; x++)
+          row[x] = static_cast<uint16_t>(row[x - 1] + unzigzag(r[x]));
+      }
+      else
+      {
+        const uint16_t *above = row - width;
+
+        row[0] = static_cast<uint16_t>(above[0] + unzigzag(r[0]));
+        for (int x = 1; x < width; x++)
+          row[x] = static_cast<uint16_t>(predict(row[x - 1], above[x]) + unzigzag(r[x]));
+      }
+    }
+    return true;
+  }
+};
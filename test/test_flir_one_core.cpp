@@ -0,0 +1,312 @@
+#include <stdint.h>
+#include <sys/time.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "flir_one_node/flir_one_core.h"
+
+using namespace driver_flir;
+
+#define THERMAL_SIZE (4 + 2 * 164 * 120)
+
+// same conversion as the core: -20 degC at 1600 counts, 75 degC at 5852
+static float valToTemp(float val)
+{
+  return -20.0f + 95.0f * (val - 1600.0f) / 4252.0f;
+}
+
+// 0x85 frame as reassembled by FlirOneCore::read(): 28-byte header, then the
+// thermal block (4 bytes, then 120 rows of 164 words with 2 extra words in
+// the middle of each row), no jpeg and no status
+static std::vector<unsigned char> makeFrame(const std::vector<uint16_t> &pix)
+{
+  std::vector<unsigned char> frame(28 + THERMAL_SIZE, 0);
+  const uint32_t thermal_size = THERMAL_SIZE;
+
+  frame[0] = 0xef;
+  frame[1] = 0xbe;
+  for (int i = 0; i < 4; i++)
+  {
+    frame[8 + i] = (thermal_size >> (8 * i)) & 0xff; // frame size
+    frame[12 + i] = (thermal_size >> (8 * i)) & 0xff;
+  }
+  for (int y = 0; y < 120; y++)
+  {
+    for (int x = 0; x < 160; x++)
+    {
+      size_t offset = 2 * (y * 164 + x) + 32 + (x < 80 ? 0 : 4);
+
+      frame[offset] = pix[y * 160 + x] & 0xff;
+      frame[offset + 1] = pix[y * 160 + x] >> 8;
+    }
+  }
+  return frame;
+}
+
+// feeds frames to a core and keeps a deep copy of the last one
+class CoreHarness
+{
+public:
+  explicit CoreHarness(const FlirOneConfig &config) : core(config), num_frames(0)
+  {
+    core.setFrameCallback([this](const FlirOneFrame &frame) {
+      last = frame;
+      last.rgb = frame.rgb.clone();
+      last.thermal = frame.thermal.clone();
+      last.ir = frame.ir.clone();
+      last.fused = frame.fused.clone();
+      num_frames++;
+    });
+  }
+
+  void process(const std::vector<uint16_t> &pix)
+  {
+    std::vector<unsigned char> frame = makeFrame(pix);
+    struct timeval stamp = {1, 0};
+
+    core.processFrame(&frame[0], frame.size(), stamp);
+  }
+
+  FlirOneCore core;
+  FlirOneFrame last;
+  int num_frames;
+};
+
+TEST(FlirOneCore, thermalExtraction)
+{
+  CoreHarness h((FlirOneConfig()));
+  std::vector<uint16_t> pix(160 * 120);
+
+  for (size_t i = 0; i < pix.size(); i++)
+  {
+    pix[i] = 2000 + i % 1000;
+  }
+  h.core.setOutputs(OUTPUT_THERMAL);
+  h.process(pix);
+
+  ASSERT_EQ(1, h.num_frames);
+  ASSERT_EQ(OUTPUT_THERMAL, h.last.outputs);
+  ASSERT_EQ(160, h.last.thermal.cols);
+  ASSERT_EQ(120, h.last.thermal.rows);
+  for (int y = 0; y < 120; y++)
+  {
+    for (int x = 0; x < 160; x++)
+    {
+      ASSERT_EQ(pix[y * 160 + x], h.last.thermal.at<uint16_t>(y, x)) << "at " << x << "," << y;
+    }
+  }
+}
+
+TEST(FlirOneCore, unrequestedOutputsStayEmpty)
+{
+  CoreHarness h((FlirOneConfig()));
+  std::vector<uint16_t> pix(160 * 120, 3000);
+
+  h.core.setOutputs(0);
+  h.process(pix);
+  ASSERT_EQ(1, h.num_frames);
+  EXPECT_EQ(0u, h.last.outputs);
+  EXPECT_TRUE(h.last.thermal.empty());
+  EXPECT_TRUE(h.last.ir.empty());
+  EXPECT_TRUE(h.last.rgb.empty());
+  EXPECT_TRUE(h.last.fused.empty());
+  EXPECT_TRUE(h.last.rois.empty());
+
+  // roi statistics need the thermal counts, but nothing is colourised
+  h.core.setOutputs(OUTPUT_ROI_STATS);
+  h.process(pix);
+  EXPECT_EQ(static_cast<unsigned int>(OUTPUT_ROI_STATS | OUTPUT_THERMAL), h.last.outputs);
+  EXPECT_TRUE(h.last.ir.empty());
+  EXPECT_TRUE(h.last.rgb.empty());
+  EXPECT_TRUE(h.last.fused.empty());
+  EXPECT_EQ(1u, h.last.rois.size());
+
+  h.core.setOutputs(OUTPUT_IR);
+  h.process(pix);
+  EXPECT_EQ(static_cast<unsigned int>(OUTPUT_IR | OUTPUT_THERMAL), h.last.outputs);
+  EXPECT_EQ(80, h.last.ir.cols);
+  EXPECT_EQ(60, h.last.ir.rows);
+  EXPECT_TRUE(h.last.rgb.empty());
+  EXPECT_TRUE(h.last.fused.empty());
+  EXPECT_TRUE(h.last.rois.empty());
+}
+
+TEST(FlirOneCore, roiStatistics)
+{
+  FlirOneConfig config;
+  config.rois.push_back(cv::Rect(10, 20, 30, 40));
+  CoreHarness h(config);
+  std::vector<uint16_t> pix(160 * 120, 3000);
+
+  pix[35 * 160 + 25] = 3100; // hottest pixel of the roi
+  pix[22 * 160 + 12] = 2900; // coldest pixel of the roi
+  pix[100 * 160 + 100] = 4000; // outside the roi
+
+  h.core.setOutputs(OUTPUT_ROI_STATS);
+  h.process(pix);
+
+  ASSERT_EQ(1u, h.last.rois.size());
+  const RoiStatistics &stats = h.last.rois[0];
+  EXPECT_EQ(10, stats.roi.x);
+  EXPECT_EQ(20, stats.roi.y);
+  EXPECT_EQ(30, stats.roi.width);
+  EXPECT_EQ(40, stats.roi.height);
+  EXPECT_NEAR(valToTemp(2900), stats.min_temp, 1e-3);
+  EXPECT_NEAR(valToTemp(3100), stats.max_temp, 1e-3);
+  EXPECT_NEAR(valToTemp(3000), stats.mean_temp, 1e-3);
+  EXPECT_EQ(25, stats.max_x);
+  EXPECT_EQ(35, stats.max_y);
+}
+
+TEST(FlirOneCore, roiStatisticsWholeFrame)
+{
+  CoreHarness h((FlirOneConfig()));
+  std::vector<uint16_t> pix(160 * 120, 3000);
+
+  pix[100 * 160 + 130] = 4000;
+  h.core.setOutputs(OUTPUT_ROI_STATS);
+  h.process(pix);
+
+  ASSERT_EQ(1u, h.last.rois.size());
+  EXPECT_NEAR(valToTemp(3000), h.last.rois[0].min_temp, 1e-3);
+  EXPECT_NEAR(valToTemp(4000), h.last.rois[0].max_temp, 1e-3);
+  EXPECT_NEAR(valToTemp(3000 + 1000.0f / (160 * 120)), h.last.rois[0].mean_temp, 1e-3);
+  EXPECT_EQ(130, h.last.rois[0].max_x);
+  EXPECT_EQ(100, h.last.rois[0].max_y);
+}
+
+TEST(FlirOneCore, autoRangePercentiles)
+{
+  FlirOneConfig config;
+  config.auto_range = true;
+  config.agc_low_percentile = 1.0;
+  config.agc_high_percentile = 99.0;
+  CoreHarness h(config);
+  std::vector<uint16_t> pix(160 * 120);
+  float min_temp, max_temp;
+
+  // 100 cold and 100 hot outliers (below 1% each), the rest at 3000 and 3400
+  for (size_t i = 0; i < pix.size(); i++)
+  {
+    pix[i] = i < 100 ? 1000 : i < 200 ? 6000 : i < 9700 ? 3000 : 3400;
+  }
+  h.core.setOutputs(OUTPUT_IR);
+  h.process(pix);
+
+  ASSERT_TRUE(h.last.outputs & OUTPUT_IR);
+  h.core.getDisplayRange(min_temp, max_temp);
+  // the first frame sets the range directly: the outliers are ignored, the
+  // top is the upper edge of the 4-count histogram bin of 3400
+  EXPECT_NEAR(valToTemp(3000), min_temp, 1e-3);
+  EXPECT_NEAR(valToTemp(3404), max_temp, 1e-3);
+
+  // a change smaller than the hysteresis does not move the range
+  for (size_t i = 200; i < pix.size(); i++)
+  {
+    pix[i] += 4;
+  }
+  h.process(pix);
+  h.core.getDisplayRange(min_temp, max_temp);
+  EXPECT_NEAR(valToTemp(3000), min_temp, 1e-3);
+  EXPECT_NEAR(valToTemp(3404), max_temp, 1e-3);
+}
+
+TEST(FlirOneCore, fixedRangeWithoutAutoRange)
+{
+  FlirOneConfig config;
+  config.min_temp = 10.0;
+  config.max_temp = 40.0;
+  CoreHarness h(config);
+  std::vector<uint16_t> pix(160 * 120, 5000);
+  float min_temp, max_temp;
+
+  h.core.setOutputs(OUTPUT_IR);
+  h.process(pix);
+  h.core.getDisplayRange(min_temp, max_temp);
+  EXPECT_NEAR(10.0, min_temp, 1e-3);
+  EXPECT_NEAR(40.0, max_temp, 1e-3);
+}
+
+TEST(FlirOneCore, temporalFilterConvergesAndResets)
+{
+  FlirOneConfig config;
+  config.temporal_filter = true;
+  config.temporal_filter_shift = 2;
+  config.temporal_filter_reset = 1.0; // ~45 counts
+  CoreHarness h(config);
+  std::vector<uint16_t> pix(160 * 120, 3000);
+
+  h.core.setOutputs(OUTPUT_THERMAL);
+
+  // the first frame initialises the filter
+  h.process(pix);
+  EXPECT_EQ(3000, h.last.thermal.at<uint16_t>(60, 80));
+
+  // a small step is averaged: a quarter of it on the next frame...
+  std::fill(pix.begin(), pix.end(), 3020);
+  h.process(pix);
+  EXPECT_EQ(3005, h.last.thermal.at<uint16_t>(60, 80));
+  EXPECT_EQ(3005, h.last.thermal.at<uint16_t>(0, 0));
+
+  // ...and reached exactly, not left a few counts short
+  for (int i = 0; i < 40; i++)
+  {
+    h.process(pix);
+  }
+  EXPECT_EQ(3020, h.last.thermal.at<uint16_t>(60, 80));
+  EXPECT_EQ(3020, h.last.thermal.at<uint16_t>(119, 159));
+
+  // same on the way down
+  std::fill(pix.begin(), pix.end(), 3010);
+  for (int i = 0; i < 40; i++)
+  {
+    h.process(pix);
+  }
+  EXPECT_EQ(3010, h.last.thermal.at<uint16_t>(60, 80));
+
+  // a jump larger than temporal_filter_reset restarts the pixel: no trail
+  pix[60 * 160 + 80] = 3500;
+  h.process(pix);
+  EXPECT_EQ(3500, h.last.thermal.at<uint16_t>(60, 80));
+  EXPECT_EQ(3010, h.last.thermal.at<uint16_t>(60, 81));
+}
+
+TEST(FlirOneCore, temporalFilterRestartsAfterSkippedFrames)
+{
+  FlirOneConfig config;
+  config.temporal_filter = true;
+  config.temporal_filter_shift = 2;
+  CoreHarness h(config);
+  std::vector<uint16_t> pix(160 * 120, 3000);
+
+  h.core.setOutputs(OUTPUT_THERMAL);
+  h.process(pix);
+
+  // nobody wants thermal data: the accumulator is not updated
+  h.core.setOutputs(0);
+  std::fill(pix.begin(), pix.end(), 3020);
+  h.process(pix);
+
+  // so the next processed frame starts from its own values
+  h.core.setOutputs(OUTPUT_THERMAL);
+  h.process(pix);
+  EXPECT_EQ(3020, h.last.thermal.at<uint16_t>(60, 80));
+}
+
+TEST(FlirOneCore, rejectsShortFrames)
+{
+  CoreHarness h((FlirOneConfig()));
+  std::vector<unsigned char> frame = makeFrame(std::vector<uint16_t>(160 * 120, 3000));
+  struct timeval stamp = {1, 0};
+
+  h.core.setOutputs(OUTPUT_THERMAL);
+
+  // the header announces more thermal data than the frame holds
+  h.core.processFrame(&frame[0], frame.size() - 100, stamp);
+  EXPECT_EQ(0, h.num_frames);
+
+  h.core.processFrame(&frame[0], 20, stamp);
+  EXPECT_EQ(0, h.num_frames);
+}
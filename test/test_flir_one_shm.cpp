@@ -0,0 +1,282 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "flir_one_node/flir_one_shm.h"
+
+using namespace driver_flir;
+
+static std::string ringName(const char *test)
+{
+  char name[64];
+
+  snprintf(name, sizeof(name), "/flir_one_test_%s_%d", test, static_cast<int>(getpid()));
+  return name;
+}
+
+// frame whose images are filled with bytes derived from seq
+class TestFrame
+{
+public:
+  explicit TestFrame(uint64_t seq) : thermal(120, 160, CV_16UC1), ir(60, 80, CV_8UC3), rgb(48, 64, CV_8UC3)
+  {
+    for (int y = 0; y < 120; y++)
+    {
+      for (int x = 0; x < 160; x++)
+      {
+        thermal.at<uint16_t>(y, x) = static_cast<uint16_t>(seq * 1000 + y * 160 + x);
+      }
+    }
+    memset(ir.data, static_cast<int>(seq & 0xff), ir.total() * ir.elemSize());
+    memset(rgb.data, static_cast<int>((seq + 1) & 0xff), rgb.total() * rgb.elemSize());
+
+    frame.outputs = OUTPUT_THERMAL | OUTPUT_IR | OUTPUT_RGB;
+    frame.stamp.tv_sec = 1000 + seq;
+    frame.stamp.tv_usec = 10 * seq;
+    frame.raw = NULL;
+    frame.raw_size = 0;
+    frame.jpeg = NULL;
+    frame.jpeg_size = 0;
+    frame.thermal = thermal;
+    frame.ir = ir;
+    frame.rgb = rgb;
+  }
+
+  cv::Mat thermal, ir, rgb;
+  FlirOneFrame frame;
+};
+
+// checks a slot copied by readLatest against the frame written with seq
+static void expectSlot(const std::vector<unsigned char> &slot, uint64_t seq)
+{
+  ASSERT_GE(slot.size(), sizeof(ShmSlotHeader));
+  const ShmSlotHeader *s = reinterpret_cast<const ShmSlotHeader *>(&slot[0]);
+  TestFrame expected(seq);
+
+  EXPECT_EQ(seq, s->seq);
+  EXPECT_EQ(static_cast<int64_t>(1000 + seq), s->stamp_sec);
+  EXPECT_EQ(static_cast<int64_t>(10 * seq), s->stamp_usec);
+
+  ASSERT_EQ(160u, s->thermal.width);
+  ASSERT_EQ(120u, s->thermal.height);
+  ASSERT_EQ(static_cast<uint32_t>(SHM_MONO16), s->thermal.format);
+  ASSERT_EQ(160u * 120u * 2u, s->thermal.size);
+  ASSERT_LE(s->thermal.offset + s->thermal.size, slot.size());
+  EXPECT_EQ(0, memcmp(&slot[s->thermal.offset], expected.thermal.data, s->thermal.size));
+
+  ASSERT_EQ(80u, s->ir.width);
+  ASSERT_EQ(60u, s->ir.height);
+  ASSERT_EQ(static_cast<uint32_t>(SHM_RGB8), s->ir.format);
+  ASSERT_EQ(80u * 60u * 3u, s->ir.size);
+  ASSERT_LE(s->ir.offset + s->ir.size, slot.size());
+  EXPECT_EQ(0, memcmp(&slot[s->ir.offset], expected.ir.data, s->ir.size));
+
+  ASSERT_EQ(64u, s->rgb.width);
+  ASSERT_EQ(48u, s->rgb.height);
+  ASSERT_EQ(static_cast<uint32_t>(SHM_RGB8), s->rgb.format);
+  ASSERT_EQ(64u * 48u * 3u, s->rgb.size);
+  ASSERT_LE(s->rgb.offset + s->rgb.size, slot.size());
+  EXPECT_EQ(0, memcmp(&slot[s->rgb.offset], expected.rgb.data, s->rgb.size));
+}
+
+TEST(FlirOneShm, writeThenRead)
+{
+  const std::string name = ringName("rw");
+  FlirOneShmWriter writer;
+  FlirOneShmReader reader;
+  std::vector<unsigned char> slot;
+
+  ASSERT_TRUE(writer.open(name, 3));
+  ASSERT_TRUE(reader.attach(name));
+
+  // nothing written yet
+  EXPECT_FALSE(reader.readLatest(slot));
+
+  for (uint64_t seq = 1; seq <= 5; seq++)
+  {
+    TestFrame f(seq);
+
+    writer.write(f.frame, false);
+    ASSERT_TRUE(reader.readLatest(slot)) << "seq " << seq;
+    expectSlot(slot, seq);
+
+    // nothing new since the last read
+    EXPECT_FALSE(reader.readLatest(slot));
+  }
+
+  // only the newest frame is returned
+  for (uint64_t seq = 6; seq <= 9; seq++)
+  {
+    TestFrame f(seq);
+    writer.write(f.frame, false);
+  }
+  ASSERT_TRUE(reader.readLatest(slot));
+  expectSlot(slot, 9);
+}
+
+TEST(FlirOneShm, unrequestedBlocksAreEmpty)
+{
+  const std::string name = ringName("empty");
+  FlirOneShmWriter writer;
+  FlirOneShmReader reader;
+  std::vector<unsigned char> slot;
+  TestFrame f(1);
+
+  ASSERT_TRUE(writer.open(name, 2));
+  ASSERT_TRUE(reader.attach(name));
+
+  f.frame.outputs = OUTPUT_THERMAL;
+  writer.write(f.frame, false);
+  ASSERT_TRUE(reader.readLatest(slot));
+
+  const ShmSlotHeader *s = reinterpret_cast<const ShmSlotHeader *>(&slot[0]);
+  EXPECT_EQ(160u * 120u * 2u, s->thermal.size);
+  EXPECT_EQ(0u, s->ir.size);
+  EXPECT_EQ(0u, s->rgb.size);
+}
+
+TEST(FlirOneShm, rejectsSlotBeingWritten)
+{
+  const std::string name = ringName("lap");
+  const unsigned int num_slots = 2;
+  FlirOneShmWriter writer;
+  FlirOneShmReader reader;
+  std::vector<unsigned char> slot;
+
+  ASSERT_TRUE(writer.open(name, num_slots));
+  ASSERT_TRUE(reader.attach(name));
+  TestFrame f(1);
+  writer.write(f.frame, false);
+
+  // second mapping to play a writer that is overwriting the slot of seq 1
+  int fd = shm_open(name.c_str(), O_RDWR, 0);
+  ASSERT_GE(fd, 0);
+  off_t size = lseek(fd, 0, SEEK_END);
+  unsigned char *base = static_cast<unsigned char *>(mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+  ASSERT_NE(MAP_FAILED, static_cast<void *>(base));
+  const ShmRingHeader *header = reinterpret_cast<const ShmRingHeader *>(base);
+  ShmSlotHeader *s = reinterpret_cast<ShmSlotHeader *>(base + header->header_size);
+
+  // lapped: seq 1 + num_slots is being written in the same slot
+  s->lock.store(2 * (1 + num_slots) - 1);
+  EXPECT_FALSE(reader.readLatest(slot));
+
+  // lapped: the slot now holds a newer frame than last_seq announced
+  s->lock.store(2 * (1 + num_slots));
+  EXPECT_FALSE(reader.readLatest(slot));
+
+  // back to the frame announced by last_seq
+  s->lock.store(2);
+  EXPECT_TRUE(reader.readLatest(slot));
+  expectSlot(slot, 1);
+
+  munmap(base, size);
+  close(fd);
+}
+
+TEST(FlirOneShm, concurrentReadsAreConsistent)
+{
+  const std::string name = ringName("race");
+  FlirOneShmWriter writer;
+  FlirOneShmReader reader;
+  std::atomic<bool> done(false);
+  int num_read = 0;
+
+  // a small ring so that the writer laps the reader often
+  ASSERT_TRUE(writer.open(name, 2));
+  ASSERT_TRUE(reader.attach(name));
+
+  std::vector<TestFrame *> frames;
+  for (uint64_t seq = 1; seq <= 16; seq++)
+  {
+    frames.push_back(new TestFrame(seq));
+  }
+
+  std::thread writer_thread([&]() {
+    for (int i = 0; i < 3000; i++)
+    {
+      writer.write(frames[i % frames.size()]->frame, false);
+    }
+    done = true;
+  });
+
+  std::vector<unsigned char> slot;
+  uint64_t last_seq = 0;
+  for (;;)
+  {
+    bool finished = done;
+
+    if (!reader.readLatest(slot))
+    {
+      if (finished)
+        break;
+      continue;
+    }
+
+    const ShmSlotHeader *s = reinterpret_cast<const ShmSlotHeader *>(&slot[0]);
+    // the ring seq differs from the frame content seq, which cycles over 16 frames
+    uint64_t content = (s->seq - 1) % frames.size() + 1;
+
+    // no ASSERT here: the writer thread must be joined
+    bool consistent = s->seq > last_seq &&
+                      s->stamp_sec == static_cast<int64_t>(1000 + content) &&
+                      memcmp(&slot[s->thermal.offset], frames[content - 1]->thermal.data, s->thermal.size) == 0 &&
+                      memcmp(&slot[s->ir.offset], frames[content - 1]->ir.data, s->ir.size) == 0 &&
+                      memcmp(&slot[s->rgb.offset], frames[content - 1]->rgb.data, s->rgb.size) == 0;
+    EXPECT_TRUE(consistent) << "torn or out of order frame, seq " << s->seq;
+    if (!consistent)
+      break;
+    last_seq = s->seq;
+    num_read++;
+  }
+  writer_thread.join();
+  EXPECT_GT(num_read, 0);
+
+  for (size_t i = 0; i < frames.size(); i++)
+  {
+    delete frames[i];
+  }
+}
+
+TEST(FlirOneShm, staleAfterWriterRestart)
+{
+  const std::string name = ringName("restart");
+  FlirOneShmWriter writer;
+  FlirOneShmReader reader;
+  std::vector<unsigned char> slot;
+
+  EXPECT_TRUE(reader.stale());
+  EXPECT_FALSE(reader.attach(name));
+
+  ASSERT_TRUE(writer.open(name, 2));
+  ASSERT_TRUE(reader.attach(name));
+  EXPECT_FALSE(reader.stale());
+
+  // clean close then restart
+  writer.close();
+  EXPECT_TRUE(reader.stale());
+  ASSERT_TRUE(writer.open(name, 2));
+  EXPECT_TRUE(reader.stale());
+
+  ASSERT_TRUE(reader.attach(name));
+  EXPECT_FALSE(reader.stale());
+  TestFrame f(1);
+  writer.write(f.frame, false);
+  ASSERT_TRUE(reader.readLatest(slot));
+  expectSlot(slot, 1);
+
+  // a writer that died without closing: the name now points to a new object
+  shm_unlink(name.c_str());
+  FlirOneShmWriter other;
+  ASSERT_TRUE(other.open(name, 2));
+  EXPECT_TRUE(reader.stale());
+}
@@ -0,0 +1,176 @@
+#include <math.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "flir_one_node/thermal_codec.h"
+
+using namespace driver_flir;
+
+// encode a width x height image stored with step bytes per row, decode it and
+// compare it with the original pixels
+static void expectRoundTrip(const std::vector<uint16_t> &pix, int width, int height, size_t step)
+{
+  std::vector<uint8_t> encoded;
+  std::vector<uint16_t> decoded;
+  int w = -1, h = -1;
+
+  encodeThermal(&pix[0], width, height, step, encoded);
+  ASSERT_TRUE(decodeThermal(&encoded[0], encoded.size(), decoded, w, h));
+  ASSERT_EQ(width, w);
+  ASSERT_EQ(height, h);
+  ASSERT_EQ(static_cast<size_t>(width) * height, decoded.size());
+
+  for (int y = 0; y < height; y++)
+  {
+    for (int x = 0; x < width; x++)
+    {
+      ASSERT_EQ(pix[y * step / 2 + x], decoded[y * width + x]) << "at " << x << "," << y;
+    }
+  }
+}
+
+// raw counts of a warm blob on a ~25 degC background, plus sensor noise
+static std::vector<uint16_t> smoothScene(int width, int height, int noise)
+{
+  std::vector<uint16_t> pix(width * height);
+
+  srand(1);
+  for (int y = 0; y < height; y++)
+  {
+    for (int x = 0; x < width; x++)
+    {
+      float dx = x - width / 2.0f;
+      float dy = y - height / 3.0f;
+      float v = 6000.0f + 800.0f * expf(-(dx * dx + dy * dy) / 400.0f) + 2.0f * y;
+
+      pix[y * width + x] = static_cast<uint16_t>(v) + rand() % (2 * noise + 1) - noise;
+    }
+  }
+  return pix;
+}
+
+static std::vector<uint16_t> randomImage(int width, int height)
+{
+  std::vector<uint16_t> pix(width * height);
+
+  srand(2);
+  for (size_t i = 0; i < pix.size(); i++)
+  {
+    pix[i] = static_cast<uint16_t>(rand());
+  }
+  // full-range steps from the left and from above
+  for (size_t i = 0; i < pix.size() && i < 8; i++)
+  {
+    pix[i] = i % 2 ? 65535 : 0;
+  }
+  for (size_t i = width; i < pix.size() && i < 2u * width; i++)
+  {
+    pix[i] = 65535 - pix[i - width];
+  }
+  return pix;
+}
+
+TEST(ThermalCodec, smoothSceneRoundTrip)
+{
+  const int noises[] = {0, 3, 5, 12};
+
+  for (size_t i = 0; i < sizeof(noises) / sizeof(noises[0]); i++)
+  {
+    SCOPED_TRACE(testing::Message() << "noise " << noises[i]);
+    expectRoundTrip(smoothScene(160, 120, noises[i]), 160, 120, 160 * 2);
+  }
+}
+
+TEST(ThermalCodec, compressionRatio)
+{
+  // +-5 counts is about the G2 noise (~0.1 degC NETD): at least 3:1
+  std::vector<uint16_t> pix = smoothScene(160, 120, 5);
+  std::vector<uint8_t> encoded;
+
+  encodeThermal(&pix[0], 160, 120, 160 * 2, encoded);
+  EXPECT_LE(3 * encoded.size(), 160u * 120u * 2u) << "ratio " << 160.0 * 120.0 * 2.0 / encoded.size();
+}
+
+TEST(ThermalCodec, randomFullRangeRoundTrip)
+{
+  expectRoundTrip(randomImage(160, 120), 160, 120, 160 * 2);
+}
+
+TEST(ThermalCodec, oddSizesRoundTrip)
+{
+  const int sizes[][2] = {{1, 1}, {1, 37}, {37, 1}, {15, 3}, {17, 5}, {33, 7}, {81, 61}};
+
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+  {
+    SCOPED_TRACE(testing::Message() << sizes[i][0] << "x" << sizes[i][1]);
+    expectRoundTrip(smoothScene(sizes[i][0], sizes[i][1], 2), sizes[i][0], sizes[i][1], sizes[i][0] * 2);
+    expectRoundTrip(randomImage(sizes[i][0] + 1, sizes[i][1]), sizes[i][0], sizes[i][1], (sizes[i][0] + 1) * 2);
+  }
+}
+
+TEST(ThermalCodec, emptyImage)
+{
+  std::vector<uint8_t> encoded;
+  std::vector<uint16_t> decoded;
+  uint16_t pix = 0;
+  int w = -1, h = -1;
+
+  encodeThermal(&pix, 0, 5, 0, encoded);
+  ASSERT_TRUE(decodeThermal(&encoded[0], encoded.size(), decoded, w, h));
+  EXPECT_EQ(0, w);
+  EXPECT_EQ(0, h);
+  EXPECT_TRUE(decoded.empty());
+}
+
+TEST(ThermalCodec, rejectsTruncatedInput)
+{
+  std::vector<uint16_t> pix = randomImage(33, 7);
+  std::vector<uint8_t> encoded;
+  std::vector<uint16_t> decoded;
+  int w, h;
+
+  encodeThermal(&pix[0], 33, 7, 33 * 2, encoded);
+  for (size_t size = 0; size < encoded.size(); size++)
+  {
+    EXPECT_FALSE(decodeThermal(&encoded[0], size, decoded, w, h)) << "size " << size;
+  }
+}
+
+TEST(ThermalCodec, rejectsGarbage)
+{
+  std::vector<uint8_t> data(4096);
+  std::vector<uint16_t> decoded;
+  int w, h;
+
+  srand(3);
+  for (size_t i = 0; i < data.size(); i++)
+  {
+    data[i] = static_cast<uint8_t>(rand());
+  }
+  // no magic
+  EXPECT_FALSE(decodeThermal(&data[0], data.size(), decoded, w, h));
+
+  // valid magic, 65535x65535 image: far more blocks than the data can hold
+  data[0] = 'F';
+  data[1] = 'T';
+  data[2] = '1';
+  data[3] = '6';
+  data[4] = data[5] = data[6] = data[7] = 0xff;
+  EXPECT_FALSE(decodeThermal(&data[0], data.size(), decoded, w, h));
+
+  // only one dimension is zero
+  const uint8_t zero_width[8] = {'F', 'T', '1', '6', 0, 0, 5, 0};
+  const uint8_t zero_height[8] = {'F', 'T', '1', '6', 5, 0, 0, 0};
+  EXPECT_FALSE(decodeThermal(zero_width, sizeof(zero_width), decoded, w, h));
+  EXPECT_FALSE(decodeThermal(zero_height, sizeof(zero_height), decoded, w, h));
+
+  // valid magic, 160x120 image with random residuals: runs out of data
+  data[4] = 160;
+  data[5] = 0;
+  data[6] = 120;
+  data[7] = 0;
+  EXPECT_FALSE(decodeThermal(&data[0], data.size(), decoded, w, h));
+}